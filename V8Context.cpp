@@ -2,10 +2,19 @@
 
 #include <pthread.h>
 #include <time.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifndef INT32_MAX
 #define INT32_MAX 0x7fffffff
 #define INT32_MIN (-0x7fffffff-1)
@@ -18,28 +27,38 @@ using namespace std;
 
 int V8Context::number = 0;
 
-v8::Isolate* isolate;
-
-void set_perl_error(const TryCatch& try_catch) {
-    Handle<Message> msg = try_catch.Message();
-
+// Touches no Perl state, so workers can use it on their own threads.
+static string format_error(Handle<Value> exception, Handle<Message> msg) {
     char message[1024];
     snprintf(
         message,
         1024,
         "%s at %s:%d:%d\n",
-        *(String::Utf8Value(try_catch.Exception())),
+        *(String::Utf8Value(exception)),
         !msg.IsEmpty() ? *(String::Utf8Value(msg->GetScriptResourceName())) : "eval",
         !msg.IsEmpty() ? msg->GetLineNumber() : 0,
         !msg.IsEmpty() ? msg->GetStartColumn(): 0
     );
 
-    sv_setpv(ERRSV, message);
+    return message;
+}
+
+static void set_perl_error(Handle<Value> exception, Handle<Message> msg) {
+    sv_setpv(ERRSV, format_error(exception, msg).c_str());
     sv_utf8_upgrade(ERRSV);
 }
 
+void set_perl_error(const TryCatch& try_catch) {
+    if (try_catch.HasTerminated()) {
+        sv_setpv(ERRSV, "JavaScript execution terminated\n");
+        return;
+    }
+
+    set_perl_error(try_catch.Exception(), try_catch.Message());
+}
+
 Handle<Value>
-check_perl_error() {
+check_perl_error(Isolate* isolate) {
     if (!SvOK(ERRSV))
         return Handle<Value>();
 
@@ -55,34 +74,92 @@ check_perl_error() {
     return Handle<Value>();
 }
 
-// Internally-used wrapper around coderefs
+// With stable_shapes, hashes with more keys than this are converted as
+// usual--V8 keeps such objects in dictionary mode anyway--and no more than
+// SHAPE_CACHE_MAX key sets get a cached template.
+#define SHAPE_MAX_KEYS  64
+#define SHAPE_CACHE_MAX 256
+
+// calculate_size() looks at no more than this many values in total, and
+// at no more than SIZE_SAMPLE_WIDTH elements of any one array or hash. The
+// remaining elements are assumed to be like the ones that were looked at.
+#define SIZE_SAMPLE_BUDGET 256
+#define SIZE_SAMPLE_WIDTH  16
+
+// Code refs close over pads we cannot cheaply walk, so they get a flat guess.
+#define SIZE_CODE_ESTIMATE 1024
+
+// One-byte strings at least this long are handed to V8 as external
+// strings over Perl's buffer instead of being copied into the heap.
+#define EXTERNAL_STRING_MIN (64 * 1024)
+
 static IV
-calculate_size(SV *sv) {
-    return 1000;
-    /*
-     * There are horrible bugs in the current Devel::Size, so we can't do this
-     * accurately. But if there weren't, this is how we'd do it!
-    dSP;
-    ENTER;
-    SAVETMPS;
+sample_size(SV *sv, int *budget) {
+    IV size = sizeof(SV);
 
-    PUSHMARK(SP);
-    XPUSHs(sv);
-    PUTBACK;
-    int returned = call_pv("Devel::Size::total_size", G_SCALAR);
-    if (returned != 1) {
-        warn("Error calculating sv size");
-        return 0;
-    }
+    if (--*budget < 0)
+        return size;
 
-    SPAGAIN;
-    IV size    = SvIV(POPs);
-    PUTBACK;
-    FREETMPS;
-    LEAVE;
+    if (SvROK(sv))
+        return size + sample_size(SvRV(sv), budget);
+
+    switch (SvTYPE(sv)) {
+    case SVt_PVAV: {
+        AV *av = (AV*)sv;
+        SSize_t len = AvFILLp(av) + 1;
+
+        size += sizeof(XPVAV) + (AvMAX(av) + 1) * sizeof(SV*);
+        if (len <= 0 || SvRMAGICAL(av) || !AvARRAY(av))
+            break;
+
+        SSize_t step = len > SIZE_SAMPLE_WIDTH ? len / SIZE_SAMPLE_WIDTH : 1;
+        SSize_t sampled = 0;
+        IV total = 0;
+        for (SSize_t i = 0; i < len && sampled < SIZE_SAMPLE_WIDTH; i += step, sampled++) {
+            if (SV *elem = AvARRAY(av)[i])
+                total += sample_size(elem, budget);
+        }
+        size += total * len / sampled;
+        break;
+    }
+    case SVt_PVHV: {
+        HV *hv = (HV*)sv;
+        IV keys = HvUSEDKEYS(hv);
+
+        size += sizeof(XPVHV) + (HvMAX(hv) + 1) * sizeof(HE*);
+        if (!keys || SvRMAGICAL(hv) || !HvARRAY(hv))
+            break;
+
+        // Walk the buckets directly so the hash iterator is left alone.
+        IV sampled = 0;
+        IV total = 0;
+        for (STRLEN i = 0; i <= HvMAX(hv) && sampled < SIZE_SAMPLE_WIDTH; i++) {
+            for (HE *he = HvARRAY(hv)[i]; he && sampled < SIZE_SAMPLE_WIDTH; he = HeNEXT(he), sampled++) {
+                total += sizeof(HE) + sizeof(HEK) + HeKLEN(he) + sample_size(HeVAL(he), budget);
+            }
+        }
+        if (sampled)
+            size += total * keys / sampled;
+        break;
+    }
+    case SVt_PVCV:
+        size += SIZE_CODE_ESTIMATE;
+        break;
+    default:
+        if (SvTYPE(sv) >= SVt_PV && SvPOKp(sv) && SvLEN(sv))
+            size += SvLEN(sv);
+        break;
+    }
 
     return size;
-    */
+}
+
+// Estimates how much memory a Perl value keeps alive, by sampling big
+// arrays and hashes rather than walking them.
+static IV
+calculate_size(SV *sv) {
+    int budget = SIZE_SAMPLE_BUDGET;
+    return sample_size(sv, &budget);
 }
 
 #define SETUP_PERL_CALL(PUSHSELF) \
@@ -96,14 +173,15 @@ calculate_size(SV *sv) {
 \
     PUSHSELF; \
 \
-    for (int i = 1; i < len; i++) { \
+    EXTEND(SP, len); \
+    for (int i = 0; i < len; i++) { \
         SV *arg = context->v82sv(args[i]); \
-        mXPUSHs(arg); \
+        mPUSHs(arg); \
     } \
     PUTBACK;
 
 #define CONVERT_PERL_RESULT() \
-    Handle<Value> error = check_perl_error(); \
+    Handle<Value> error = check_perl_error(context->isolate); \
 \
     if (!error.IsEmpty()) { \
         FREETMPS; \
@@ -120,31 +198,12 @@ calculate_size(SV *sv) {
 \
     return v;
 
-void SvMap::add(Handle<Object> object, long ptr) {
-    objects.insert(
-        pair<int, SimpleObjectData*>(
-            object->GetIdentityHash(),
-            new SimpleObjectData(object, ptr)
-        )
-    );
-}
-
-SV* SvMap::find(Handle<Object> object) {
-    int hash = object->GetIdentityHash();
-
-    for (sv_map::const_iterator it = objects.find(hash); it != objects.end() && it->first == hash; it++)
-        if (it->second->object->Equals(object))
-            return newRV_inc(INT2PTR(SV*, it->second->ptr));
-
-    return NULL;
-}
-
 ObjectData::ObjectData(V8Context* context_, Handle<Object> object_, SV* sv_)
 {
     context = context_;
     sv = sv_;
 
-    Persistent<Object, CopyablePersistentTraits<Object>> persistent(isolate, object_);
+    Persistent<Object, CopyablePersistentTraits<Object>> persistent(context->isolate, object_);
 
     object = persistent;
 
@@ -162,13 +221,14 @@ ObjectData::~ObjectData() {
 
 PerlObjectData::PerlObjectData(V8Context* context_, Handle<Object> object_, SV* sv_)
     : ObjectData(context_, object_, sv_)
-    , bytes(size())
+    , isolate(context_->isolate)
+    , bytes(0)
 {
     if (!sv)
         return;
 
     SvREFCNT_inc(sv);
-    add_size(calculate_size(sv));
+    add_size(size() + calculate_size(sv));
     ptr = PTR2IV(sv);
 
     object.SetWeak(this, PerlObjectData::destroy, v8::WeakCallbackType::kParameter);
@@ -222,16 +282,96 @@ class V8FunctionData : public V8ObjectData {
 public:
     V8FunctionData(V8Context* context_, Handle<Object> object_, SV* sv_)
         : V8ObjectData(context_, object_, sv_)
-        , returns_list(object_->Has(String::NewFromUtf8(isolate, "__perlReturnsList", v8::String::kNormalString)))
+        , returns_list(object_->Has(String::NewFromUtf8(context_->isolate, "__perlReturnsList", v8::String::kNormalString)))
     { }
 
     bool returns_list;
 };
 
+// JavaScript objects and arrays returned with lazy_results become tied
+// hashes and arrays. The proxy hangs off the hash or array itself, so the
+// JavaScript object lives as long as the Perl container; the tie object
+// only holds a weak reference back to the container.
+class V8ProxyData : public V8ObjectData {
+public:
+    V8ProxyData(V8Context* context_, Handle<Object> object_, SV* sv_)
+        : V8ObjectData(context_, object_, sv_)
+        , next_key(0)
+    { }
+
+    virtual ~V8ProxyData() {
+        keys.Reset();
+    }
+
+    // FIRSTKEY/NEXTKEY state
+    Persistent<Array, CopyablePersistentTraits<Array>> keys;
+    uint32_t next_key;
+};
+
+// Byte strings returned for ArrayBuffers, DataViews and Uint8Arrays. The
+// scalar's PV points straight into the backing store, which the persistent
+// handle keeps alive for as long as the scalar.
+class V8BufferData : public V8ObjectData {
+public:
+    V8BufferData(V8Context* context_, Handle<Object> object_, SV* sv_, char* data, size_t length)
+        : V8ObjectData(context_, object_, sv_)
+    {
+        SvUPGRADE(sv, SVt_PV);
+        SvPV_set(sv, length ? data : (char*)"");
+        SvCUR_set(sv, length);
+        SvLEN_set(sv, 0); // not ours to free
+        SvPOK_only(sv);
+        SvREADONLY_on(sv);
+    }
+
+    // The isolate is about to be disposed and takes its backing stores
+    // with it, so the scalar gets its own copy of the bytes.
+    void copy_out() {
+        char *copy;
+        Newx(copy, SvCUR(sv) + 1, char);
+        Copy(SvPVX(sv), copy, SvCUR(sv), char);
+        copy[SvCUR(sv)] = '\0';
+        SvPV_set(sv, copy);
+        SvLEN_set(sv, SvCUR(sv) + 1);
+    }
+
+    // The buffer's contents went to a worker, so the scalar is left empty
+    // rather than pointing at memory it no longer shares.
+    void detach() {
+        if (SvLEN(sv))
+            Safefree(SvPVX(sv));
+        SvPV_set(sv, (char*)"");
+        SvCUR_set(sv, 0);
+        SvLEN_set(sv, 0);
+    }
+};
+
+// Perl callbacks which settle the promise standing in for a Perl future
+// or promise. The callback holds the resolver, so the promise can still be
+// settled for as long as whatever the callback was given to keeps it.
+class V8ResolverData : public V8ObjectData {
+public:
+    V8ResolverData(V8Context* context_, Handle<Object> object_, SV* sv_, bool reject_)
+        : V8ObjectData(context_, object_, sv_)
+        , reject(reject_)
+    { }
+
+    bool reject;
+};
+
 class PerlFunctionData : public PerlObjectData {
 private:
     SV *rv;
-    Local<Value> *thisWrapped;
+
+    // Perl subs are native functions; the External carries this object so
+    // JS arguments reach invoke() without an intermediate JS frame. Not
+    // through a FunctionTemplate: the context caches every template it
+    // instantiates for good, which would keep each sub alive.
+    static Handle<Object> make_function(V8Context* context, PerlFunctionData* data) {
+        Isolate* isolate = context->isolate;
+        return Function::New(context->get_local_context(), v8invoke, External::New(isolate, data))
+            .ToLocalChecked();
+    }
 
 protected:
     virtual Handle<Value> invoke(const v8::FunctionCallbackInfo<v8::Value>& args);
@@ -239,33 +379,14 @@ protected:
 
 public:
     PerlFunctionData(V8Context* context_, SV *cv)
-        : PerlObjectData(
-              context_,
-              Handle<Object>::Cast(
-                  context_->make_function.Get(isolate)->Call(
-                      context_->get_local_context(),
-                      context_->get_local_context()->Global(),
-                      1,
-                      thisWrapped = new Local<Value>(External::New(isolate, this))
-                  ).ToLocalChecked()
-              ),
-              cv
-          )
+        : PerlObjectData(context_, make_function(context_, this), cv)
        , rv(cv ? newRV_noinc(cv) : NULL)
     { }
 
-    ~PerlFunctionData() {
-        delete thisWrapped;
-    }
-
     static void v8invoke(const v8::FunctionCallbackInfo<v8::Value>& args) {
-        v8::Local<v8::External> ext = args[0].As<v8::External>();
+        PerlFunctionData* data = static_cast<PerlFunctionData*>(args.Data().As<External>()->Value());
 
-        PerlFunctionData* data = static_cast<PerlFunctionData*>(ext->Value());
-
-        if (data != NULL) {
-            args.GetReturnValue().Set(data->invoke(args));
-        }
+        args.GetReturnValue().Set(data->invoke(args));
     }
 };
 
@@ -273,9 +394,12 @@ size_t PerlFunctionData::size() {
     return sizeof(PerlFunctionData);
 }
 
-void PerlObjectData::add_size(size_t bytes_) {
+// The isolate is kept apart from the context, which is cleared when the
+// context goes away, so that the memory is still given back to a shared
+// isolate when the wrapper is collected later.
+void PerlObjectData::add_size(int64_t bytes_) {
     bytes += bytes_;
-    //V8::AdjustAmountOfExternalAllocatedMemory(bytes_);
+    isolate->AdjustAmountOfExternalAllocatedMemory(bytes_);
 }
 
 Handle<Value>
@@ -309,261 +433,1822 @@ size_t PerlMethodData::size() {
     return sizeof(PerlMethodData);
 }
 
-// V8Context class starts here
+// Perl arrays and hashes bound with bind_view. The JavaScript object has
+// no properties of its own: interceptors go to the Perl data on every
+// access, and nested arrays and hashes become views in turn.
+class PerlViewData : public PerlObjectData {
+private:
+    template <class T>
+    static PerlViewData* unwrap(const PropertyCallbackInfo<T>& info) {
+        PerlViewData* data = static_cast<PerlViewData*>(info.Holder()->GetAlignedPointerFromInternalField(0));
+        return data->context ? data : NULL;
+    }
 
-V8Context::V8Context(
-    int time_limit,
-    const char* flags,
-    bool enable_blessing_,
-    const char* bless_prefix_
-)
-    : time_limit_(time_limit),
-      bless_prefix(bless_prefix_),
-      enable_blessing(enable_blessing_)
-{
-    // Set flags before creating the isolate--otherwise some flags are
-    // ineffective.
-    V8::SetFlagsFromString(flags, strlen(flags));
+    static Local<Name> index_name(Isolate* isolate, uint32_t index) {
+        return Integer::NewFromUnsigned(isolate, index)->ToString();
+    }
 
-    if (!isolate) {
-        //v8::V8::InitializeICU();
-        Platform* platform = platform::CreateDefaultPlatform();
-        V8::InitializePlatform(platform);
-        V8::Initialize();
+    Handle<Value> wrap(SV* sv) {
+        SvGETMAGIC(sv);
+        return context->sv2view(sv);
+    }
 
-        v8::Isolate::CreateParams create_params;
+    virtual size_t size();
 
-        create_params.array_buffer_allocator =
-            v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+public:
+    PerlViewData(V8Context* context_, Handle<Object> object_, SV* sv_)
+        : PerlObjectData(context_, object_, sv_)
+    {
+        object_->SetAlignedPointerInInternalField(0, this);
+    }
+
+    // Keys reach Perl as UTF-8, which hv_fetch and friends downgrade again
+    // for hashes holding the key as bytes.
+    static void hash_get(Local<Name> name, const PropertyCallbackInfo<Value>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
 
-        isolate = v8::Isolate::New(create_params);
+        String::Utf8Value key(name);
+        if (SV** val = hv_fetch((HV*)data->sv, *key, -key.length(), 0))
+            info.GetReturnValue().Set(data->wrap(*val));
     }
 
-    Isolate::Scope isolate_scope(isolate);
+    static void hash_set(Local<Name> name, Local<Value> value, const PropertyCallbackInfo<Value>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
 
-    HandleScope handle_scope(isolate);
+        String::Utf8Value key(name);
+        SV* sv = data->context->v82sv(value);
+        if (!hv_store((HV*)data->sv, *key, -key.length(), sv, 0))
+            SvREFCNT_dec(sv);
+        info.GetReturnValue().Set(value);
+    }
 
-    v8::Local<v8::ObjectTemplate> global = v8::ObjectTemplate::New(isolate);
+    static void hash_query(Local<Name> name, const PropertyCallbackInfo<Integer>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
 
-    v8::Local<v8::Context> context = Context::New(isolate, NULL, global);
+        String::Utf8Value key(name);
+        if (hv_exists((HV*)data->sv, *key, -key.length()))
+            info.GetReturnValue().Set(static_cast<int32_t>(None));
+    }
 
-    Persistent<Context, CopyablePersistentTraits<Context>> persistent_context(isolate, context);
+    static void hash_delete(Local<Name> name, const PropertyCallbackInfo<Boolean>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
 
-    this->context = persistent_context;
+        String::Utf8Value key(name);
+        if (hv_exists((HV*)data->sv, *key, -key.length())) {
+            hv_delete((HV*)data->sv, *key, -key.length(), G_DISCARD);
+            info.GetReturnValue().Set(true);
+        }
+    }
 
-    Context::Scope context_scope(context);
+    static void hash_keys(const PropertyCallbackInfo<Array>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
+
+        Isolate* isolate = info.GetIsolate();
+        Local<Context> ctx = isolate->GetCurrentContext();
+        HV* hv = (HV*)data->sv;
+        Local<Array> keys = Array::New(isolate, HvUSEDKEYS(hv));
+        uint32_t i = 0;
+
+        ENTER;
+        SAVETMPS;
+        hv_iterinit(hv);
+        while (HE* he = hv_iternext(hv))
+            keys->Set(ctx, i++, data->context->sv2v8(hv_iterkeysv(he))).FromJust();
+        FREETMPS;
+        LEAVE;
+
+        info.GetReturnValue().Set(keys);
+    }
 
-    Local<FunctionTemplate> tmpl = FunctionTemplate::New(isolate, PerlFunctionData::v8invoke);
+    // Integer-like keys of a hash arrive through the indexed interceptor.
+    static void hash_get_index(uint32_t index, const PropertyCallbackInfo<Value>& info) {
+        hash_get(index_name(info.GetIsolate(), index), info);
+    }
 
-    context->Global()->Set(
-        v8::String::NewFromUtf8(isolate, "__perlFunctionWrapper", v8::String::kNormalString),
-        tmpl->GetFunction()
-    );
+    static void hash_set_index(uint32_t index, Local<Value> value, const PropertyCallbackInfo<Value>& info) {
+        hash_set(index_name(info.GetIsolate(), index), value, info);
+    }
 
-    Handle<Script> script = Script::Compile(
-        v8::String::NewFromUtf8(
-            isolate,
-            "(function(wrap) {"
-            "    return function() {"
-            "        var args = Array.prototype.slice.call(arguments);"
-            "        args.unshift(wrap);"
-            "        return __perlFunctionWrapper.apply(this, args)"
-            "    };"
-            "})",
-            v8::String::kNormalString
-        )
-    );
+    static void hash_query_index(uint32_t index, const PropertyCallbackInfo<Integer>& info) {
+        hash_query(index_name(info.GetIsolate(), index), info);
+    }
 
-    make_function.Reset(isolate, Handle<Function>::Cast(script->Run()));
+    static void hash_delete_index(uint32_t index, const PropertyCallbackInfo<Boolean>& info) {
+        hash_delete(index_name(info.GetIsolate(), index), info);
+    }
 
-    string_wrap.Reset(isolate, String::NewFromUtf8(isolate, "wrap"));
+    static void array_get(uint32_t index, const PropertyCallbackInfo<Value>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
 
-    number++;
-}
+        if (SV** val = av_fetch((AV*)data->sv, index, 0))
+            info.GetReturnValue().Set(data->wrap(*val));
+    }
 
-Local<Context> V8Context::get_local_context() {
-    return Local<Context>::New(isolate, context);
-}
+    static void array_set(uint32_t index, Local<Value> value, const PropertyCallbackInfo<Value>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
 
-void V8Context::register_object(ObjectData* data) {
-    seen_perl[data->ptr] = data;
+        SV* sv = data->context->v82sv(value);
+        if (!av_store((AV*)data->sv, index, sv))
+            SvREFCNT_dec(sv);
+        info.GetReturnValue().Set(value);
+    }
 
-    v8::Local<v8::Private> privateKey = v8::Private::ForApi(isolate, string_wrap.Get(isolate));
-    auto local = v8::Local<v8::Object>::New(isolate, data->object);
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+    static void array_query(uint32_t index, const PropertyCallbackInfo<Integer>& info) {
+        PerlViewData* data = unwrap(info);
+        if (data && av_exists((AV*)data->sv, index))
+            info.GetReturnValue().Set(static_cast<int32_t>(None));
+    }
 
-    local->SetPrivate(context, privateKey, External::New(isolate, data));
+    static void array_delete(uint32_t index, const PropertyCallbackInfo<Boolean>& info) {
+        PerlViewData* data = unwrap(info);
+        if (data && av_exists((AV*)data->sv, index)) {
+            av_delete((AV*)data->sv, index, G_DISCARD);
+            info.GetReturnValue().Set(true);
+        }
+    }
+
+    static void array_keys(const PropertyCallbackInfo<Array>& info) {
+        PerlViewData* data = unwrap(info);
+        if (!data)
+            return;
+
+        Isolate* isolate = info.GetIsolate();
+        Local<Context> ctx = isolate->GetCurrentContext();
+        AV* av = (AV*)data->sv;
+        I32 len = av_len(av) + 1;
+        Local<Array> keys = Array::New(isolate, len);
+        uint32_t n = 0;
+
+        for (I32 i = 0; i < len; i++) {
+            if (av_exists(av, i))
+                keys->Set(ctx, n++, Integer::New(isolate, i)).FromJust();
+        }
+        info.GetReturnValue().Set(keys);
+    }
+
+    // Arrays only intercept "length"; everything else, such as map or
+    // forEach, comes from Array.prototype.
+    static bool is_length(Local<Name> name) {
+        if (!name->IsString() || Local<String>::Cast(name)->Length() != 6)
+            return false;
+        return strcmp(*String::Utf8Value(name), "length") == 0;
+    }
+
+    static void array_length(Local<Name> name, const PropertyCallbackInfo<Value>& info) {
+        PerlViewData* data = unwrap(info);
+        if (data && is_length(name))
+            info.GetReturnValue().Set(static_cast<int32_t>(av_len((AV*)data->sv) + 1));
+    }
+
+    static void array_set_length(Local<Name> name, Local<Value> value, const PropertyCallbackInfo<Value>& info) {
+        PerlViewData* data = unwrap(info);
+        if (data && is_length(name)) {
+            av_fill((AV*)data->sv, (I32)value->Uint32Value() - 1);
+            info.GetReturnValue().Set(value);
+        }
+    }
+};
+
+size_t PerlViewData::size() {
+    return sizeof(PerlViewData);
 }
 
-void V8Context::remove_object(ObjectData* data) {
-    ObjectDataMap::iterator it = seen_perl.find(data->ptr);
-    if (it != seen_perl.end())
-        seen_perl.erase(it);
+// Perl byte strings bound with bind_buffer. The ArrayBuffer uses the PV
+// as its backing store, so the scalar is kept alive and read-only (Perl
+// must not move the PV) until the ArrayBuffer is collected.
+class PerlBufferData : public PerlObjectData {
+private:
+    bool was_readonly;
 
-    HandleScope scope(isolate);
-    Local<Context> local_context = Local<Context>::New(isolate, context);
-    Context::Scope context_scope(local_context);
+    static Handle<Object> make_buffer(V8Context* context, SV* sv) {
+        return ArrayBuffer::New(context->isolate, SvPVX(sv), SvCUR(sv), ArrayBufferCreationMode::kExternalized);
+    }
 
-    v8::Local<v8::Private> privateKey = v8::Private::ForApi(isolate, string_wrap.Get(isolate));
-    auto local = v8::Local<v8::Object>::New(isolate, data->object);
+    virtual size_t size();
 
-    if (local.IsEmpty()) {
-      return;
+public:
+    PerlBufferData(V8Context* context_, SV* sv_)
+        : PerlObjectData(context_, make_buffer(context_, sv_), sv_)
+        , was_readonly(SvREADONLY(sv_))
+    {
+        SvREADONLY_on(sv);
     }
 
-    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+    virtual ~PerlBufferData() {
+        if (!was_readonly)
+            SvREADONLY_off(sv);
+    }
+};
 
-    local->DeletePrivate(context, privateKey);
+size_t PerlBufferData::size() {
+    return sizeof(PerlBufferData);
 }
 
-V8Context::~V8Context() {
-    for (ObjectDataMap::iterator it = seen_perl.begin(); it != seen_perl.end(); it++) {
-        it->second->context = NULL;
+// Large one-byte strings are shared with V8 rather than copied. The
+// resource holds its own copy of the scalar, which Perl makes by sharing
+// the buffer copy-on-write where it can, so changing the original later
+// leaves the bytes V8 sees alone. V8 calls Dispose() once the string is
+// collected.
+class PerlStringResource : public String::ExternalOneByteStringResource {
+private:
+    SV* sv;
+
+public:
+    PerlStringResource(SV* sv_) : sv(newSVsv(sv_)) { }
+
+    virtual const char* data() const {
+        return SvPVX(sv);
     }
-    seen_perl.clear();
 
-    for (ObjectMap::iterator it = prototypes.begin(); it != prototypes.end(); it++) {
-      it->second.Reset();
+    virtual size_t length() const {
+        return SvCUR(sv);
     }
-    context.ClearWeak();
-    string_wrap.Reset();
-    make_function.Reset();
+
+    virtual void Dispose() {
+        SvREFCNT_dec(sv);
+        delete this;
+    }
+};
+
+// Reads a whole file into a new[]'d buffer, NULL if it can't be read.
+static uint8_t*
+read_file(const string& path, int* length) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size <= 0 || size > INT32_MAX || lseek(fd, 0, SEEK_SET) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t* data = new uint8_t[size];
+    off_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, data + done, size - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    close(fd);
+
+    if (done != size) {
+        delete[] data;
+        return NULL;
+    }
+
+    *length = size;
+    return data;
 }
 
-void
-V8Context::bind(const char *name, SV *thing) {
-    Isolate::Scope isolate_scope(isolate);
-    HandleScope scope(isolate);
+// Written to a temporary file and renamed, so concurrent processes never
+// see a partial file.
+static bool
+write_file(const string& path, const uint8_t* data, int length) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+    string tmp = path + suffix;
+
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    int done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, data + done, length - done);
+        if (n <= 0)
+            break;
+        done += n;
+    }
 
-    Local<Context> local_context = Local<Context>::New(isolate, context);
-    Context::Scope context_scope(local_context);
+    if (close(fd) == 0 && done == length && rename(tmp.c_str(), path.c_str()) == 0)
+        return true;
 
-    local_context->Global()->Set(v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString), sv2v8(thing));
+    unlink(tmp.c_str());
+    return false;
 }
 
-void
-V8Context::bind_ro(const char *name, SV *thing) {
-    Isolate::Scope isolate_scope(isolate);
-    HandleScope scope(isolate);
+// Native callbacks reachable from the heap. Isolates restored from a
+// snapshot need the same list the snapshot was created with.
+static intptr_t external_references[] = {
+    reinterpret_cast<intptr_t>(PerlFunctionData::v8invoke),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_get),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_set),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_query),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_delete),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_keys),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_get_index),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_set_index),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_query_index),
+    reinterpret_cast<intptr_t>(PerlViewData::hash_delete_index),
+    reinterpret_cast<intptr_t>(PerlViewData::array_get),
+    reinterpret_cast<intptr_t>(PerlViewData::array_set),
+    reinterpret_cast<intptr_t>(PerlViewData::array_query),
+    reinterpret_cast<intptr_t>(PerlViewData::array_delete),
+    reinterpret_cast<intptr_t>(PerlViewData::array_keys),
+    reinterpret_cast<intptr_t>(PerlViewData::array_length),
+    reinterpret_cast<intptr_t>(PerlViewData::array_set_length),
+    0
+};
 
-    Local<Context> local_context = Local<Context>::New(isolate, context);
-    Context::Scope context_scope(local_context);
+static Platform* v8_platform;
 
-    bool result = context.Get(isolate)->Global()->DefineOwnProperty(
-        isolate->GetCurrentContext(),
-        v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString),
-        sv2v8(thing),
-        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete)
-    ).IsJust();
+// The platform is shared by every isolate in the process, so the size of
+// its worker pool (0 lets V8 choose) is up to whoever gets here first.
+static void
+init_v8(int threads = 0) {
+    if (v8_platform)
+        return;
+
+    //v8::V8::InitializeICU();
+    v8_platform = platform::CreateDefaultPlatform(threads, platform::IdleTaskSupport::kEnabled);
+    V8::InitializePlatform(v8_platform);
+    V8::Initialize();
 }
 
-void V8Context::name_global(const char *name) {
-    HandleScope scope(isolate);
+// Foreground tasks V8 posts for an isolate--finishing off concurrent
+// compilation, incremental marking steps and the like--wait for us to run
+// them. A pump at a safe point runs no more than this many.
+#define PUMP_MAX_TASKS 64
 
-    Local<Context> local_context = Local<Context>::New(isolate, context);
-    Context::Scope context_scope(local_context);
+// Calls from Perl into JavaScript in progress, across all contexts. The
+// message loop is only pumped when none are, so tasks never run with
+// JavaScript on the stack.
+static int js_calls;
 
-    bool result = context.Get(isolate)->Global()->DefineOwnProperty(
-        isolate->GetCurrentContext(),
-        v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString),
-        context.Get(isolate)->Global(),
-        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete)
-    ).IsJust();
+struct js_call {
+    js_call() { js_calls++; }
+    ~js_call() { js_calls--; }
+};
+
+static int
+pump_tasks(Isolate* isolate, int max) {
+    int ran = 0;
+    while (ran < max && platform::PumpMessageLoop(v8_platform, isolate))
+        ran++;
+    return ran;
+}
+
+// Promise reactions are JavaScript on the stack like any other.
+static void
+drain_microtasks(Isolate* isolate) {
+    js_call call;
+    isolate->RunMicrotasks();
 }
 
-// I fucking hate pthreads, this lacks error handling, but hopefully works.
-class thread_canceller {
+// Every backing store gets one more byte than asked for, always 0, so the
+// byte strings buffer2sv() makes over one are NUL-terminated like any
+// other Perl string.
+class TerminatedAllocator : public ArrayBuffer::Allocator {
 public:
-    thread_canceller(int sec)
-        : sec_(sec)
-    {
-        if (sec_) {
-            pthread_cond_init(&cond_, NULL);
-            pthread_mutex_init(&mutex_, NULL);
-            pthread_mutex_lock(&mutex_); // passed locked to canceller
-            pthread_create(&id_, NULL, canceller, this);
-        }
+    virtual void* Allocate(size_t length) {
+        return calloc(length + 1, 1);
     }
 
-    ~thread_canceller() {
-        if (sec_) {
-            pthread_mutex_lock(&mutex_);
-            pthread_cond_signal(&cond_);
-            pthread_mutex_unlock(&mutex_);
-            void *ret;
-            pthread_join(id_, &ret);
-            pthread_mutex_destroy(&mutex_);
-            pthread_cond_destroy(&cond_);
-        }
+    virtual void* AllocateUninitialized(size_t length) {
+        char* data = (char*)malloc(length + 1);
+        if (data)
+            data[length] = '\0';
+        return data;
     }
 
-private:
+    virtual void Free(void* data, size_t) {
+        free(data);
+    }
+};
 
-    static void* canceller(void* this_) {
-        thread_canceller* me = static_cast<thread_canceller*>(this_);
-        struct timeval tv;
-        struct timespec ts;
-        gettimeofday(&tv, NULL);
-        ts.tv_sec = tv.tv_sec + me->sec_;
-        ts.tv_nsec = tv.tv_usec * 1000;
+// V8 can't be asked for a flag's value, so the initial old space size the
+// user set is remembered for when initial_heap_mb has overridden it.
+static int initial_old_space_flag = 0;
 
-        if (pthread_cond_timedwait(&me->cond_, &me->mutex_, &ts) == ETIMEDOUT) {
-            V8::TerminateExecution(isolate);
-        }
-        pthread_mutex_unlock(&me->mutex_);
-        return NULL;
+static void
+set_v8_flags(const char* flags) {
+    V8::SetFlagsFromString(flags, strlen(flags));
+
+    string normalized(flags);
+    replace(normalized.begin(), normalized.end(), '_', '-');
+
+    const char* name = "initial-old-space-size";
+    for (size_t at = normalized.find(name); at != string::npos; at = normalized.find(name, at + 1)) {
+        const char* value = normalized.c_str() + at + strlen(name);
+        while (*value == '=' || *value == ' ')
+            value++;
+        if (isdigit((unsigned char)*value))
+            initial_old_space_flag = atoi(value);
     }
+}
 
-    pthread_t id_;
-    pthread_cond_t cond_;
-    pthread_mutex_t mutex_;
-    int sec_;
-};
+// Contexts in the same group share an isolate, and with it a heap, garbage
+// collection and termination. Contexts which don't ask for anything else
+// share the default group, which lives as long as the process; other
+// groups are disposed with their last context.
+class IsolateGroup {
+public:
+    static IsolateGroup* acquire(
+        const char* name,
+        bool own,
+        const char* snapshot,
+        int max_heap_mb,
+        int initial_heap_mb
+    ) {
+#if !V8_VERSION_AT_LEAST(6, 5)
+        // There is no way to stop V8 aborting the process at the limit
+        if (max_heap_mb)
+            croak("max_heap_mb needs V8 6.5 or later");
+#endif
 
-SV*
-V8Context::eval(SV* source, SV* origin) {
-    Isolate::Scope isolate_scope(isolate);
-    HandleScope handle_scope(isolate);
-    TryCatch try_catch;
-    Local<Context> local_context = context.Get(isolate);
-    Context::Scope context_scope(local_context);
+        if (!own) {
+            map<string, IsolateGroup*>::iterator it = groups.find(name);
+            if (it != groups.end()) {
+                IsolateGroup* group = it->second;
 
-    // V8 expects everything in UTF-8, ensure SVs are upgraded.
-    sv_utf8_upgrade(source);
-    Handle<Script> script = Script::Compile(
-        sv2v8str(source),
-        origin ? sv2v8str(origin) : String::NewFromUtf8(isolate, "eval", v8::String::kNormalString)
-    );
+                // A snapshot can only be deserialized into a fresh isolate.
+                if (group->snapshot != snapshot)
+                    croak("The V8 isolate for this group was already created %s%s",
+                        group->snapshot.empty() ? "without a snapshot" : "from ",
+                        group->snapshot.c_str());
+
+                group->contexts++;
+                return group;
+            }
+        }
+
+        v8::Isolate::CreateParams create_params;
+        StartupData blob = { NULL, 0 };
+
+        if (*snapshot) {
+            int length;
+            char* data = (char*)read_file(snapshot, &length);
+            if (!data)
+                croak("Unable to read snapshot %s", snapshot);
+
+            blob.data = data;
+            blob.raw_size = length;
+        }
+
+        init_v8();
+
+        IsolateGroup* group = new IsolateGroup(name, own, snapshot, blob);
+
+        if (blob.data)
+            create_params.snapshot_blob = &group->blob;
+        create_params.array_buffer_allocator = group->allocator;
+        create_params.external_references = external_references;
+
+        if (max_heap_mb)
+            create_params.constraints.set_max_old_space_size(max_heap_mb);
+
+        // ResourceConstraints has no initial size, but the flag is only read
+        // when a heap is set up, so it can be scoped to this isolate.
+        if (initial_heap_mb)
+            set_flag("--initial-old-space-size=%d", initial_heap_mb);
+
+        group->isolate = v8::Isolate::New(create_params);
+
+        // Each call into JavaScript says whether microtasks run when it
+        // returns; see V8Context::microtasks_scope().
+        group->isolate->SetMicrotasksPolicy(MicrotasksPolicy::kScoped);
+
+        if (initial_heap_mb)
+            set_flag("--initial-old-space-size=%d", initial_old_space_flag);
+
+#if V8_VERSION_AT_LEAST(6, 5)
+        if (max_heap_mb)
+            group->isolate->AddNearHeapLimitCallback(near_heap_limit, group);
+#endif
+
+        if (!own)
+            groups[name] = group;
+
+        return group;
+    }
+
+    // True if releasing this context will dispose of the isolate.
+    bool last_context() {
+        return contexts == 1 && (own || !name.empty());
+    }
+
+    void release() {
+        if (!last_context()) {
+            contexts--;
+            return;
+        }
+
+        if (!own)
+            groups.erase(name);
+
+        delete this;
+    }
+
+#if V8_VERSION_AT_LEAST(6, 5)
+    // Instead of letting V8 abort the process when the heap is exhausted,
+    // the script is terminated and given some headroom to unwind in.
+    static size_t near_heap_limit(void* data, size_t current_heap_limit, size_t initial_heap_limit) {
+        IsolateGroup* group = static_cast<IsolateGroup*>(data);
+
+        group->heap_limit_reached = true;
+        group->initial_heap_limit = initial_heap_limit;
+        group->isolate->TerminateExecution();
+
+        return current_heap_limit + current_heap_limit / 2;
+    }
+#endif
+
+    // Called after a script failed; true if it was because it ran out of
+    // heap, in which case the garbage is collected.
+    bool recover_heap_limit() {
+        if (!heap_limit_reached)
+            return false;
+
+        heap_limit_reached = false;
+        heap_limit_raised = true;
+        isolate->CancelTerminateExecution();
+        isolate->LowMemoryNotification();
+        restore_heap_limit();
+
+        return true;
+    }
+
+    // The raised limit stays until the heap has room again: whatever
+    // filled it may still be reachable, and releasing it should not run
+    // out of heap in turn. Checked after every successful script.
+    void restore_heap_limit() {
+#if V8_VERSION_AT_LEAST(6, 5)
+        if (!heap_limit_raised)
+            return;
+
+        HeapStatistics stats;
+        isolate->GetHeapStatistics(&stats);
+        if (stats.used_heap_size() > initial_heap_limit / 4 * 3)
+            return;
+
+        heap_limit_raised = false;
+        isolate->RemoveNearHeapLimitCallback(near_heap_limit, initial_heap_limit);
+        isolate->AddNearHeapLimitCallback(near_heap_limit, this);
+#endif
+    }
+
+    Isolate* isolate;
+
+private:
+    static void set_flag(const char* format, int value) {
+        char flag[64];
+        snprintf(flag, sizeof(flag), format, value);
+        V8::SetFlagsFromString(flag, strlen(flag));
+    }
+
+    IsolateGroup(const char* name_, bool own_, const char* snapshot_, StartupData blob_)
+        : name(name_)
+        , own(own_)
+        , snapshot(snapshot_)
+        , blob(blob_)
+        , allocator(new TerminatedAllocator())
+        , contexts(1)
+        , heap_limit_reached(false)
+        , heap_limit_raised(false)
+        , initial_heap_limit(0)
+    { }
+
+    ~IsolateGroup() {
+        isolate->Dispose();
+        delete allocator;
+        delete[] blob.data;
+    }
+
+    string name;
+    bool own;
+    string snapshot;
+    StartupData blob;
+    ArrayBuffer::Allocator* allocator;
+    int contexts;
+    bool heap_limit_reached;
+    bool heap_limit_raised;
+    size_t initial_heap_limit;
+
+    static map<string, IsolateGroup*> groups;
+};
+
+map<string, IsolateGroup*> IsolateGroup::groups;
+
+// V8Context class starts here
+
+static void install_proxy_methods();
+
+V8Context::V8Context(
+    int time_limit,
+    const char* flags,
+    bool enable_blessing_,
+    const char* bless_prefix_,
+    const char* code_cache_dir_,
+    const char* snapshot,
+    const char* isolate_group,
+    bool own_isolate,
+    int max_heap_mb,
+    int initial_heap_mb,
+    bool stable_shapes_,
+    bool lazy_results_,
+    bool typed_arrays_,
+    bool acyclic_,
+    int bulk_threshold_,
+    bool explicit_microtasks_,
+    bool timers_,
+    int platform_threads,
+    bool futures_
+)
+    : time_limit_(time_limit),
+      bless_prefix(bless_prefix_),
+      code_cache_dir(code_cache_dir_ ? code_cache_dir_ : ""),
+      code_cache_hits(0),
+      code_cache_misses(0),
+      code_cache_rejects(0),
+      evals(0),
+      total_evals(0),
+      enable_blessing(enable_blessing_),
+      stable_shapes(stable_shapes_),
+      lazy_results(lazy_results_),
+      typed_arrays(typed_arrays_),
+      acyclic(acyclic_),
+      bulk_threshold(bulk_threshold_),
+      explicit_microtasks(explicit_microtasks_),
+      install_timers(timers_),
+      futures(futures_),
+      microtasks_pending(false),
+      timers(NULL),
+      bulk_to_js(0),
+      bulk_to_perl(0),
+      direct_to_js(0),
+      direct_to_perl(0),
+      bulk_bailouts(0),
+      materializing(false)
+{
+    // Set flags before creating the isolate--otherwise some flags are
+    // ineffective.
+    set_v8_flags(flags);
+
+    if (lazy_results)
+        install_proxy_methods();
+
+    init_v8(platform_threads);
+
+    group = IsolateGroup::acquire(
+        isolate_group ? isolate_group : "",
+        own_isolate,
+        snapshot ? snapshot : "",
+        max_heap_mb,
+        initial_heap_mb
+    );
+    isolate = group->isolate;
+
+    Isolate::Scope isolate_scope(isolate);
+
+    HandleScope handle_scope(isolate);
+
+    // With a snapshot this deserializes its default context, libraries and
+    // all.
+    v8::Local<v8::Context> context = Context::New(isolate);
+
+    Persistent<Context, CopyablePersistentTraits<Context>> persistent_context(isolate, context);
+
+    this->context = persistent_context;
+
+    string_wrap.Reset(isolate, String::NewFromUtf8(isolate, "wrap"));
+
+    start_timers(context);
+
+    number++;
+}
+
+SV*
+V8Context::create_snapshot(const char* file, SV* sources) {
+    if (!SvROK(sources) || SvTYPE(SvRV(sources)) != SVt_PVAV)
+        croak("create_snapshot: scripts must be an array reference");
+
+    init_v8();
+
+    AV* av = (AV*)SvRV(sources);
+    bool ok = true;
+    SnapshotCreator creator(external_references);
+    Isolate* creator_isolate = creator.GetIsolate();
+
+    {
+        Isolate::Scope isolate_scope(creator_isolate);
+        HandleScope handle_scope(creator_isolate);
+        Local<Context> snapshot_context = Context::New(creator_isolate);
+        Context::Scope context_scope(snapshot_context);
+        TryCatch try_catch(creator_isolate);
+
+        for (I32 i = 0; ok && i <= av_len(av); i++) {
+            SV** source = av_fetch(av, i, 0);
+            if (!source)
+                continue;
+
+            char name[32];
+            snprintf(name, sizeof(name), "snapshot[%d]", (int)i);
+            ScriptOrigin origin(String::NewFromUtf8(creator_isolate, name));
+
+            // Copied as they are: the caller's scalars aren't upgraded, and
+            // a snapshot can't hold external strings.
+            STRLEN len;
+            const char* pv = SvPV(*source, len);
+            MaybeLocal<String> code = SvUTF8(*source)
+                ? String::NewFromUtf8(creator_isolate, pv, NewStringType::kNormal, len)
+                : String::NewFromOneByte(creator_isolate, (const uint8_t*)pv, NewStringType::kNormal, len);
+
+            Local<String> code_str;
+            Local<Script> script;
+            ok = code.ToLocal(&code_str)
+                && Script::Compile(snapshot_context, code_str, &origin).ToLocal(&script)
+                && !script->Run(snapshot_context).IsEmpty();
+        }
+
+        if (ok)
+            creator.SetDefaultContext(snapshot_context);
+        else
+            set_perl_error(try_catch);
+    }
+
+    if (!ok)
+        return &PL_sv_undef;
+
+    StartupData blob = creator.CreateBlob(SnapshotCreator::FunctionCodeHandling::kClear);
+    ok = blob.data && write_file(file, (const uint8_t*)blob.data, blob.raw_size);
+    delete[] blob.data;
+
+    if (!ok) {
+        sv_setpvf(ERRSV, "Unable to write snapshot %s", file);
+        return &PL_sv_undef;
+    }
+
+    sv_setsv(ERRSV, &PL_sv_undef);
+    return &PL_sv_yes;
+}
+
+Local<Context> V8Context::get_local_context() {
+    return Local<Context>::New(isolate, context);
+}
+
+void V8Context::register_object(ObjectData* data) {
+    seen_perl[data->ptr] = data;
+
+    v8::Local<v8::Private> privateKey = v8::Private::ForApi(isolate, string_wrap.Get(isolate));
+    auto local = v8::Local<v8::Object>::New(isolate, data->object);
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    local->SetPrivate(context, privateKey, External::New(isolate, data));
+}
+
+void V8Context::remove_object(ObjectData* data) {
+    ObjectDataMap::iterator it = seen_perl.find(data->ptr);
+    if (it != seen_perl.end())
+        seen_perl.erase(it);
+
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+    Local<Context> local_context = Local<Context>::New(isolate, context);
+    Context::Scope context_scope(local_context);
+
+    v8::Local<v8::Private> privateKey = v8::Private::ForApi(isolate, string_wrap.Get(isolate));
+    auto local = v8::Local<v8::Object>::New(isolate, data->object);
+
+    if (local.IsEmpty()) {
+      return;
+    }
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    local->DeletePrivate(context, privateKey);
+}
+
+V8Context::~V8Context() {
+    stop_timers();
+    detach_objects(group->last_context());
+    clear_shapes();
+    hash_view.Reset();
+    array_view.Reset();
+    context.Reset();
+    string_wrap.Reset();
+    group->release();
+}
+
+// Everything here belongs to the current JavaScript context: wrappers are
+// told the context is gone and cached prototypes and scripts are dropped.
+// If the isolate is about to be disposed its weak callbacks will never
+// run, so handles are released here instead.
+void V8Context::detach_objects(bool disposing) {
+    // Before anything is released: these may point into Perl buffers too
+    if (disposing) {
+        for (ObjectDataMap::iterator it = seen_perl.begin(); it != seen_perl.end(); it++) {
+            if (V8BufferData* buffer = dynamic_cast<V8BufferData*>(it->second))
+                buffer->copy_out();
+        }
+    }
+
+    for (ObjectDataMap::iterator it = seen_perl.begin(); it != seen_perl.end(); it++) {
+        ObjectData* data = it->second;
+        data->context = NULL;
+
+        if (disposing) {
+            if (PerlObjectData* perl = dynamic_cast<PerlObjectData*>(data))
+                delete perl;
+            else
+                data->object.Reset();
+
+            // An each() may be part way through
+            if (V8ProxyData* proxy = dynamic_cast<V8ProxyData*>(data))
+                proxy->keys.Reset();
+        }
+    }
+    seen_perl.clear();
+
+    for (set<V8Script*>::iterator it = scripts.begin(); it != scripts.end(); it++) {
+        (*it)->script.Reset();
+        (*it)->context = NULL;
+    }
+    scripts.clear();
+
+    for (ObjectMap::iterator it = prototypes.begin(); it != prototypes.end(); it++) {
+      it->second.Reset();
+    }
+    prototypes.clear();
+}
+
+void
+V8Context::reset() {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+
+    clear_timers();
+    detach_objects(false);
+
+    Local<Context> fresh = Context::New(isolate);
+    context.Reset(isolate, fresh);
+    start_timers(fresh);
+    evals = 0;
+}
+
+int
+V8Context::eval_count() {
+    return evals;
+}
+
+int
+V8Context::total_eval_count() {
+    return total_evals;
+}
+
+void
+V8Context::bind(const char *name, SV *thing) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+
+    Local<Context> local_context = Local<Context>::New(isolate, context);
+    Context::Scope context_scope(local_context);
+
+    local_context->Global()->Set(v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString), sv2v8(thing));
+}
+
+void
+V8Context::bind_buffer(const char *name, SV *thing) {
+    if (SvROK(thing) || !SvPOK(thing) || SvUTF8(thing))
+        croak("bind_buffer needs a byte string");
+
+    // Strings sharing their PV with others are unshared first, or given a
+    // copy if that is impossible, so JavaScript writes only reach this one.
+    if (SvREADONLY(thing) || SvLEN(thing) == 0)
+        thing = sv_2mortal(newSVpvn(SvPVX(thing), SvCUR(thing)));
+#ifdef SvIsCOW
+    else if (SvIsCOW(thing))
+        sv_force_normal_flags(thing, 0);
+#endif
+
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+
+    Local<Context> local_context = Local<Context>::New(isolate, context);
+    Context::Scope context_scope(local_context);
+
+    Handle<ArrayBuffer> buffer;
+    ObjectDataMap::iterator it = seen_perl.find(PTR2IV(thing));
+    if (it != seen_perl.end() && dynamic_cast<PerlBufferData*>(it->second))
+        buffer = Handle<ArrayBuffer>::Cast(it->second->object.Get(isolate));
+    else
+        buffer = Handle<ArrayBuffer>::Cast((new PerlBufferData(this, thing))->object.Get(isolate));
+
+    local_context->Global()->Set(
+        v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString),
+        Uint8Array::New(buffer, 0, buffer->ByteLength())
+    );
+}
+
+void
+V8Context::bind_view(const char *name, SV *thing) {
+    if (!SvROK(thing) || SvOBJECT(SvRV(thing))
+        || (SvTYPE(SvRV(thing)) != SVt_PVAV && SvTYPE(SvRV(thing)) != SVt_PVHV))
+        croak("bind_view needs an array or hash reference");
+
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+
+    Local<Context> local_context = Local<Context>::New(isolate, context);
+    Context::Scope context_scope(local_context);
+
+    local_context->Global()->Set(v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString), sv2view(thing));
+}
+
+void
+V8Context::bind_ro(const char *name, SV *thing) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+
+    Local<Context> local_context = Local<Context>::New(isolate, context);
+    Context::Scope context_scope(local_context);
+
+    bool result = context.Get(isolate)->Global()->DefineOwnProperty(
+        isolate->GetCurrentContext(),
+        v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString),
+        sv2v8(thing),
+        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete)
+    ).IsJust();
+}
+
+void V8Context::name_global(const char *name) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+
+    Local<Context> local_context = Local<Context>::New(isolate, context);
+    Context::Scope context_scope(local_context);
+
+    bool result = context.Get(isolate)->Global()->DefineOwnProperty(
+        isolate->GetCurrentContext(),
+        v8::String::NewFromUtf8(isolate, name, v8::String::kNormalString),
+        context.Get(isolate)->Global(),
+        v8::PropertyAttribute(v8::ReadOnly | v8::DontDelete)
+    ).IsJust();
+}
+
+// Makes a pipe readable; a full pipe is readable already.
+static void
+poke(int fd) {
+    ssize_t n = write(fd, "", 1);
+    (void)n;
+}
+
+// One long-lived thread per process enforces every time limit. Each eval
+// arms a deadline in a shared map, which costs a mutex and a tree insert; the
+// thread sleeps until the earliest deadline and terminates only the isolate
+// that deadline belongs to.
+class watchdog {
+public:
+    // A timer either terminates the isolate's script or, with a wake_fd,
+    // makes that descriptor readable.
+    struct timer {
+        Isolate* isolate;
+        int wake_fd;
+        bool fired;
+    };
+
+    typedef multimap<uint64_t, timer*> timer_map;
+
+    static timer_map::iterator arm(timer* t, int ms) {
+        pthread_once(&once_, init);
+        pthread_mutex_lock(&mutex_);
+
+        if (!running_) {
+            pthread_t id;
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            running_ = pthread_create(&id, &attr, run, NULL) == 0;
+            pthread_attr_destroy(&attr);
+        }
+
+        timer_map::iterator it = timers_.insert(make_pair(now_ms() + ms, t));
+
+        // Only wake the thread if it is sleeping past the new deadline.
+        if (it == timers_.begin())
+            pthread_cond_signal(&cond_);
+
+        pthread_mutex_unlock(&mutex_);
+        return it;
+    }
+
+    static void disarm(timer* t, timer_map::iterator it) {
+        pthread_mutex_lock(&mutex_);
+        // A fired timer has already been removed by the watchdog thread.
+        if (!t->fired)
+            timers_.erase(it);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    static uint64_t now_ms() {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+
+private:
+    static void init() {
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&cond_, NULL);
+        pthread_atfork(NULL, NULL, after_fork);
+    }
+
+    // Only the forking thread survives in the child, so the watchdog has to
+    // be restarted on the next arm, and the lock may have been held by it.
+    static void after_fork() {
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&cond_, NULL);
+        running_ = false;
+    }
+
+    static void* run(void*) {
+        pthread_mutex_lock(&mutex_);
+
+        for (;;) {
+            if (timers_.empty()) {
+                pthread_cond_wait(&cond_, &mutex_);
+                continue;
+            }
+
+            timer_map::iterator it = timers_.begin();
+
+            if (it->first <= now_ms()) {
+                it->second->fired = true;
+                if (it->second->wake_fd >= 0)
+                    poke(it->second->wake_fd);
+                else
+                    it->second->isolate->TerminateExecution();
+                timers_.erase(it);
+                continue;
+            }
+
+            struct timespec ts;
+            ts.tv_sec = it->first / 1000;
+            ts.tv_nsec = (it->first % 1000) * 1000000;
+            pthread_cond_timedwait(&cond_, &mutex_, &ts);
+        }
+
+        return NULL;
+    }
+
+    static pthread_once_t once_;
+    static pthread_mutex_t mutex_;
+    static pthread_cond_t cond_;
+    static bool running_;
+    static timer_map timers_;
+};
+
+pthread_once_t watchdog::once_ = PTHREAD_ONCE_INIT;
+pthread_mutex_t watchdog::mutex_;
+pthread_cond_t watchdog::cond_;
+bool watchdog::running_ = false;
+watchdog::timer_map watchdog::timers_;
+
+// Arms the watchdog for the lifetime of a scope; a limit of 0 means none.
+class watchdog_timer {
+public:
+    watchdog_timer(Isolate* isolate, int ms)
+        : ms_(ms)
+    {
+        timer_.isolate = isolate;
+        timer_.wake_fd = -1;
+        timer_.fired = false;
+
+        if (ms_)
+            it_ = watchdog::arm(&timer_, ms_);
+    }
+
+    ~watchdog_timer() {
+        if (!ms_)
+            return;
+
+        watchdog::disarm(&timer_, it_);
+
+        // The deadline may have passed just after the script finished, in
+        // which case the termination is still pending and would hit
+        // whatever runs next on this isolate.
+        if (timer_.fired)
+            timer_.isolate->CancelTerminateExecution();
+    }
+
+    bool fired() const { return timer_.fired; }
+
+private:
+    watchdog::timer timer_;
+    watchdog::timer_map::iterator it_;
+    int ms_;
+};
+
+// setTimeout() and friends, for contexts created with timers. Callbacks
+// only run from run_pending() (or while eval_async() waits), never behind
+// Perl's back. Work becomes due when a timer's deadline passes--which the
+// watchdog thread reports by making wake_fd readable--or when a call
+// leaves microtasks queued, so an event loop can watch the read end.
+class TimerQueue {
+public:
+    TimerQueue(V8Context* context_)
+        : context(context_)
+        , next_id(1)
+        , armed(false)
+    {
+        fds[0] = fds[1] = -1;
+        wake.isolate = context->isolate;
+        wake.wake_fd = -1;
+        wake.fired = false;
+    }
+
+    ~TimerQueue() {
+        disarm();
+        clear();
+        if (fds[0] >= 0) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+    }
+
+    void install(Local<Context> ctx) {
+        Isolate* isolate = context->isolate;
+        Local<Object> global = ctx->Global();
+        Local<External> self = External::New(isolate, this);
+
+        global->Set(String::NewFromUtf8(isolate, "setTimeout"), Function::New(ctx, set_timeout, self).ToLocalChecked());
+        global->Set(String::NewFromUtf8(isolate, "setInterval"), Function::New(ctx, set_interval, self).ToLocalChecked());
+        global->Set(String::NewFromUtf8(isolate, "clearTimeout"), Function::New(ctx, clear_timer, self).ToLocalChecked());
+        global->Set(String::NewFromUtf8(isolate, "clearInterval"), Function::New(ctx, clear_timer, self).ToLocalChecked());
+    }
+
+    void clear() {
+        for (map<int, Timer>::iterator it = timers.begin(); it != timers.end(); it++)
+            it->second.reset();
+        timers.clear();
+        queue.clear();
+        rearm();
+    }
+
+    // The read end of the pipe, created on first use.
+    int fd() {
+        if (fds[0] < 0 && pipe(fds) == 0) {
+            for (int i = 0; i < 2; i++) {
+                fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+                fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+            }
+            wake.wake_fd = fds[1];
+            rearm();
+        }
+        return fds[0];
+    }
+
+    void signal() {
+        if (fds[1] >= 0)
+            poke(fds[1]);
+    }
+
+    void drain() {
+        char buf[64];
+        if (fds[0] >= 0)
+            while (read(fds[0], buf, sizeof(buf)) > 0) { }
+    }
+
+    // Deadline in ms since the epoch of the earliest timer, or 0 if none.
+    uint64_t next_deadline() const {
+        return queue.empty() ? 0 : queue.begin()->first;
+    }
+
+    // Timers due by now, in deadline order.
+    void due(uint64_t now, vector<int>& ids) const {
+        for (set<pair<uint64_t, int> >::const_iterator it = queue.begin(); it != queue.end() && it->first <= now; it++)
+            ids.push_back(it->second);
+    }
+
+    // Runs a timer if it is still there, rescheduling intervals first so
+    // that the callback can clear them. False if the callback threw.
+    bool run(int id, uint64_t now, Local<Context> ctx) {
+        map<int, Timer>::iterator it = timers.find(id);
+        if (it == timers.end())
+            return true;
+
+        Isolate* isolate = context->isolate;
+        Timer& timer = it->second;
+        Local<Function> callback = timer.callback.Get(isolate);
+        vector<Local<Value> > argv;
+        for (size_t i = 0; i < timer.args.size(); i++)
+            argv.push_back(timer.args[i].Get(isolate));
+
+        queue.erase(make_pair(timer.deadline, id));
+        if (timer.interval) {
+            timer.deadline = now + timer.interval;
+            queue.insert(make_pair(timer.deadline, id));
+        }
+        else {
+            timer.reset();
+            timers.erase(it);
+        }
+
+        return !callback->Call(ctx, ctx->Global(), argv.size(), argv.empty() ? NULL : &argv[0]).IsEmpty();
+    }
+
+    // Points the watchdog at the earliest deadline, if anyone is watching.
+    void rearm() {
+        disarm();
+        if (wake.wake_fd < 0 || queue.empty())
+            return;
+
+        uint64_t now = watchdog::now_ms(), deadline = next_deadline();
+        if (deadline <= now) {
+            signal();
+            return;
+        }
+        wake.fired = false;
+        wake_it = watchdog::arm(&wake, deadline - now);
+        armed = true;
+    }
+
+private:
+    struct Timer {
+        Persistent<Function, CopyablePersistentTraits<Function> > callback;
+        vector<Persistent<Value, CopyablePersistentTraits<Value> > > args;
+        uint64_t deadline;
+        int interval;
+
+        void reset() {
+            callback.Reset();
+            for (size_t i = 0; i < args.size(); i++)
+                args[i].Reset();
+        }
+    };
+
+    V8Context* context;
+    map<int, Timer> timers;
+    set<pair<uint64_t, int> > queue;
+    int next_id;
+    int fds[2];
+    watchdog::timer wake;
+    watchdog::timer_map::iterator wake_it;
+    bool armed;
+
+    void disarm() {
+        if (armed)
+            watchdog::disarm(&wake, wake_it);
+        armed = false;
+    }
+
+    static void add(const FunctionCallbackInfo<Value>& args, bool repeat) {
+        TimerQueue* self = (TimerQueue*)args.Data().As<External>()->Value();
+        Isolate* isolate = args.GetIsolate();
+
+        if (args.Length() < 1 || !args[0]->IsFunction()) {
+            isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Timer callback is not a function")));
+            return;
+        }
+
+        double delay = args.Length() > 1 ? args[1]->NumberValue(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+        int ms = delay >= 1 && delay < INT32_MAX ? (int)delay : delay >= INT32_MAX ? INT32_MAX : 0;
+
+        int id = self->next_id++;
+        Timer& timer = self->timers[id];
+        timer.callback.Reset(isolate, Local<Function>::Cast(args[0]));
+        for (int i = 2; i < args.Length(); i++)
+            timer.args.push_back(Persistent<Value, CopyablePersistentTraits<Value> >(isolate, args[i]));
+        timer.deadline = watchdog::now_ms() + ms;
+        // Intervals of 0 would never let run_pending() catch up
+        timer.interval = repeat ? max(ms, 1) : 0;
+
+        bool earliest = self->queue.empty() || timer.deadline < self->next_deadline();
+        self->queue.insert(make_pair(timer.deadline, id));
+        if (earliest)
+            self->rearm();
+
+        args.GetReturnValue().Set(id);
+    }
+
+    static void set_timeout(const FunctionCallbackInfo<Value>& args) {
+        add(args, false);
+    }
+
+    static void set_interval(const FunctionCallbackInfo<Value>& args) {
+        add(args, true);
+    }
+
+    static void clear_timer(const FunctionCallbackInfo<Value>& args) {
+        TimerQueue* self = (TimerQueue*)args.Data().As<External>()->Value();
+        if (args.Length() < 1 || !args[0]->IsInt32())
+            return;
+
+        map<int, Timer>::iterator it = self->timers.find(args[0]->Int32Value());
+        if (it == self->timers.end())
+            return;
+
+        self->queue.erase(make_pair(it->second.deadline, it->first));
+        it->second.reset();
+        self->timers.erase(it);
+    }
+};
+
+void
+V8Context::start_timers(Local<Context> ctx) {
+    if (!timers)
+        timers = new TimerQueue(this);
+    if (install_timers)
+        timers->install(ctx);
+}
+
+// Timers belong to the global object they were set on, but the queue and
+// the pipe behind pending_fd() stay, so event loops watching it carry on.
+void
+V8Context::clear_timers() {
+    timers->clear();
+    timers->drain();
+    microtasks_pending = false;
+}
+
+// Only when the context goes away; see clear_timers().
+void
+V8Context::stop_timers() {
+    delete timers;
+    timers = NULL;
+    microtasks_pending = false;
+}
+
+// With explicit microtasks, a call into JavaScript may leave some queued
+// for run_pending().
+void
+V8Context::queued_microtasks() {
+    if (explicit_microtasks && !microtasks_pending) {
+        microtasks_pending = true;
+        timers->signal();
+    }
+}
+
+// Runs waiting platform tasks and microtasks, then the timers due by
+// now--but not those they set in turn--up to max of them if max is not 0.
+// Returns how many timers ran, or -1 with $@ set if one of them threw.
+int
+V8Context::run_timers(Local<Context> ctx, TryCatch& try_catch, int max) {
+    timers->drain();
+    if (!js_calls)
+        pump_tasks(isolate, PUMP_MAX_TASKS);
+    microtasks_pending = false;
+    drain_microtasks(isolate);
+
+    uint64_t now = watchdog::now_ms();
+    vector<int> due;
+    timers->due(now, due);
+
+    int ran = 0;
+    for (size_t i = 0; i < due.size() && (!max || ran < max); i++, ran++) {
+        watchdog_timer timer(isolate, time_limit_);
+        bool ok;
+        {
+            js_call call;
+            MicrotasksScope microtasks(isolate, MicrotasksScope::kDoNotRunMicrotasks);
+            ok = timers->run(due[i], now, ctx);
+        }
+        if (ok)
+            drain_microtasks(isolate);
+
+        if (!ok || try_catch.HasCaught()) {
+            set_call_error(try_catch);
+            timers->rearm();
+            return -1;
+        }
+    }
+
+    if ((size_t)ran < due.size())
+        timers->signal();
+    else
+        timers->rearm();
+    return ran;
+}
+
+// Sets $@ for a call into JavaScript which failed, which may have been
+// terminated for running out of heap.
+void
+V8Context::set_call_error(const TryCatch& try_catch) {
+    if (group->recover_heap_limit())
+        sv_setpv(ERRSV, "JavaScript heap limit exceeded\n");
+    else
+        set_perl_error(try_catch);
+}
+
+int
+V8Context::pump_message_loop() {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    Context::Scope context_scope(context.Get(isolate));
+
+    return js_calls ? 0 : pump_tasks(isolate, INT_MAX);
+}
+
+void
+V8Context::run_idle_tasks(double seconds) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    Context::Scope context_scope(context.Get(isolate));
+
+    if (!js_calls)
+        platform::RunIdleTasks(v8_platform, isolate, seconds);
+}
+
+int
+V8Context::pending_fd() {
+    int fd = timers->fd();
+    if (microtasks_pending)
+        timers->signal();
+    return fd;
+}
+
+SV*
+V8Context::next_deadline() {
+    uint64_t deadline = microtasks_pending ? watchdog::now_ms() : timers->next_deadline();
+    return deadline ? newSVnv(deadline / 1000.0) : &PL_sv_undef;
+}
+
+SV*
+V8Context::run_pending(int max) {
+    int ran;
+    {
+        Isolate::Scope isolate_scope(isolate);
+        HandleScope handle_scope(isolate);
+        TryCatch try_catch;
+        Local<Context> local_context = context.Get(isolate);
+        Context::Scope context_scope(local_context);
+
+        ran = run_timers(local_context, try_catch, max);
+    }
+
+    if (ran < 0)
+        return &PL_sv_undef;
+    sv_setsv(ERRSV, &PL_sv_undef);
+    return newSViv(ran);
+}
+
+SV*
+V8Context::eval(SV* source, SV* origin) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    TryCatch try_catch;
+    Local<Context> local_context = context.Get(isolate);
+    Context::Scope context_scope(local_context);
+
+    Handle<Script> script = compile_script(source, origin);
 
     if (try_catch.HasCaught()) {
         set_perl_error(try_catch);
         return &PL_sv_undef;
-    } else {
-        thread_canceller canceller(time_limit_);
-        Handle<Value> val = script->Run();
+    }
+
+    return run_script(script, try_catch);
+}
+
+Handle<Script>
+V8Context::compile_script(SV* source, SV* origin) {
+    Handle<String> source_str = sv2v8str(source);
+    Handle<String> origin_str = origin ? sv2v8str(origin) : String::NewFromUtf8(isolate, "eval", v8::String::kNormalString);
+
+    if (!code_cache_dir.empty())
+        return compile_cached(source_str, origin_str, code_cache_path(source, origin));
+
+    return Script::Compile(source_str, origin_str);
+}
+
+// FNV-1a; only used to name code cache files, V8 checks the source itself.
+static uint64_t
+hash_bytes(uint64_t hash, const char* p, STRLEN len) {
+    while (len--) {
+        hash ^= (unsigned char)*p++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+string
+V8Context::code_cache_path(SV* source, SV* origin) {
+    STRLEN source_len, origin_len = 0;
+    const char* source_pv = SvPV(source, source_len);
+    const char* origin_pv = origin ? SvPVutf8(origin, origin_len) : "eval";
+    const char* version = V8::GetVersion();
+
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hash_bytes(hash, version, strlen(version) + 1);
+    hash = hash_bytes(hash, origin_pv, origin ? origin_len + 1 : 5);
+    hash = hash_bytes(hash, source_pv, source_len);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx-%lu.v8cache", (unsigned long long)hash, (unsigned long)source_len);
+
+    return code_cache_dir + name;
+}
+
+Handle<Script>
+V8Context::compile_cached(Handle<String> source, Handle<String> origin, const string& path) {
+    Local<Context> local_context = isolate->GetCurrentContext();
+    int length;
+    uint8_t* data = read_file(path, &length);
+    ScriptCompiler::CachedData* cached = data
+        ? new ScriptCompiler::CachedData(data, length, ScriptCompiler::CachedData::BufferOwned)
+        : NULL;
+    Local<Script> script;
+
+    {
+        // The source takes ownership of the cached data.
+        ScriptCompiler::Source script_source(source, ScriptOrigin(origin), cached);
+
+        if (!ScriptCompiler::Compile(
+                local_context,
+                &script_source,
+                cached ? ScriptCompiler::kConsumeCodeCache : ScriptCompiler::kNoCompileOptions
+            ).ToLocal(&script))
+            return Handle<Script>();
+
+        if (!cached) {
+            code_cache_misses++;
+        }
+        else if (script_source.GetCachedData()->rejected) {
+            // Produced by another V8 version or with different flags
+            code_cache_rejects++;
+        }
+        else {
+            code_cache_hits++;
+            return script;
+        }
+    }
+
+#if V8_VERSION_AT_LEAST(6, 4)
+    ScriptCompiler::CachedData* produced = ScriptCompiler::CreateCodeCache(script->GetUnboundScript(), source);
+    if (produced) {
+        write_file(path, produced->data, produced->length);
+        delete produced;
+    }
+#else
+    ScriptCompiler::Source produce_source(source, ScriptOrigin(origin));
+    if (!ScriptCompiler::Compile(local_context, &produce_source, ScriptCompiler::kProduceCodeCache).IsEmpty()
+        && produce_source.GetCachedData())
+        write_file(path, produce_source.GetCachedData()->data, produce_source.GetCachedData()->length);
+#endif
+
+    return script;
+}
+
+SV*
+V8Context::code_cache_stats() {
+    HV* hv = newHV();
+
+    hv_stores(hv, "hits", newSViv(code_cache_hits));
+    hv_stores(hv, "misses", newSViv(code_cache_misses));
+    hv_stores(hv, "rejects", newSViv(code_cache_rejects));
+
+    return newRV_noinc((SV*)hv);
+}
+
+SV*
+V8Context::conversion_stats() {
+    HV* hv = newHV();
+
+    hv_stores(hv, "bulk_to_js", newSViv(bulk_to_js));
+    hv_stores(hv, "bulk_to_perl", newSViv(bulk_to_perl));
+    hv_stores(hv, "direct_to_js", newSViv(direct_to_js));
+    hv_stores(hv, "direct_to_perl", newSViv(direct_to_perl));
+    hv_stores(hv, "bulk_bailouts", newSViv(bulk_bailouts));
+
+    return newRV_noinc((SV*)hv);
+}
+
+SV*
+V8Context::eval_async(SV* source, SV* origin) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    TryCatch try_catch;
+    Local<Context> local_context = context.Get(isolate);
+    Context::Scope context_scope(local_context);
+
+    Handle<Script> script = compile_script(source, origin);
+
+    if (try_catch.HasCaught()) {
+        set_perl_error(try_catch);
+        return &PL_sv_undef;
+    }
+
+    return run_script(script, try_catch, true);
+}
+
+void
+V8Context::run_microtasks() {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    Context::Scope context_scope(context.Get(isolate));
+
+    watchdog_timer timer(isolate, time_limit_);
+    drain_microtasks(isolate);
+}
 
-        if (val.IsEmpty()) {
+SV*
+V8Context::run_script(Handle<Script> script, TryCatch& try_catch, bool async) {
+    evals++;
+    total_evals++;
+
+    watchdog_timer timer(isolate, time_limit_);
+    Handle<Value> val;
+    {
+        js_call call;
+        MicrotasksScope microtasks(isolate, async ? MicrotasksScope::kDoNotRunMicrotasks : microtasks_scope());
+        val = script->Run();
+    }
+    if (!async)
+        queued_microtasks();
+    if (!js_calls)
+        pump_tasks(isolate, PUMP_MAX_TASKS);
+
+    if (!val.IsEmpty() && async && val->IsPromise())
+        val = settle(Handle<Promise>::Cast(val), try_catch);
+
+    if (val.IsEmpty()) {
+        if (group->recover_heap_limit())
+            sv_setpv(ERRSV, "JavaScript heap limit exceeded\n");
+        else if (try_catch.HasCaught())
             set_perl_error(try_catch);
+        else if (isolate->IsExecutionTerminating())
+            sv_setpv(ERRSV, "JavaScript execution terminated\n");
+        return &PL_sv_undef;
+    } else {
+        group->restore_heap_limit();
+        sv_setsv(ERRSV,&PL_sv_undef);
+        if (GIMME_V == G_VOID) {
             return &PL_sv_undef;
-        } else {
-            sv_setsv(ERRSV,&PL_sv_undef);
-            if (GIMME_V == G_VOID) {
-                return &PL_sv_undef;
-            }
-            return v82sv(val);
         }
+        return v82sv(val);
+    }
+}
+
+// Runs microtasks, and timers as they come due, until the promise
+// settles. Returns its value, or an empty handle if it is rejected or
+// nothing is left that could settle it, with $@ set unless the caller's
+// try_catch has the reason.
+Handle<Value>
+V8Context::settle(Handle<Promise> promise, TryCatch& try_catch) {
+    uint64_t start = watchdog::now_ms();
+
+    while (promise->State() == Promise::kPending) {
+        drain_microtasks(isolate);
+        if (try_catch.HasCaught() || isolate->IsExecutionTerminating())
+            return Handle<Value>();
+        if (promise->State() != Promise::kPending)
+            break;
+
+        // Nothing but a timer can settle it now
+        uint64_t deadline = timers->next_deadline();
+        if (!deadline)
+            break;
+        uint64_t now = watchdog::now_ms();
+        if (time_limit_ && deadline > start + time_limit_) {
+            sv_setpv(ERRSV, "JavaScript execution terminated\n");
+            return Handle<Value>();
+        }
+        if (deadline > now) {
+            if (!js_calls)
+                pump_tasks(isolate, PUMP_MAX_TASKS);
+            usleep((deadline - now) * 1000);
+        }
+        if (run_timers(isolate->GetCurrentContext(), try_catch, 0) < 0)
+            return Handle<Value>();
+    }
+
+    switch (promise->State()) {
+    case Promise::kFulfilled:
+        return promise->Result();
+    case Promise::kRejected: {
+        Handle<Value> reason = promise->Result();
+        set_perl_error(reason, Exception::CreateMessage(isolate, reason));
+        return Handle<Value>();
+    }
+    default:
+        sv_setpv(ERRSV, "JavaScript promise never settled\n");
+        return Handle<Value>();
+    }
+}
+
+SV*
+V8Context::compile(SV* source, SV* origin) {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    TryCatch try_catch;
+    Local<Context> local_context = context.Get(isolate);
+    Context::Scope context_scope(local_context);
+
+    Handle<Script> script = compile_script(source, origin);
+
+    if (try_catch.HasCaught()) {
+        set_perl_error(try_catch);
+        return &PL_sv_undef;
+    }
+
+    sv_setsv(ERRSV, &PL_sv_undef);
+
+    return sv_setref_pv(newSV(0), "JavaScript::V8::Script", new V8Script(this, script));
+}
+
+SV*
+V8Context::compile_function(SV* params, SV* body, SV* origin) {
+    if (!SvROK(params) || SvTYPE(SvRV(params)) != SVt_PVAV)
+        croak("compile_function: parameters must be an array reference");
+
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    TryCatch try_catch;
+    Local<Context> local_context = context.Get(isolate);
+    Context::Scope context_scope(local_context);
+
+    AV* av = (AV*)SvRV(params);
+    vector<Local<String> > names;
+
+    for (I32 i = 0; i <= av_len(av); i++) {
+        SV** name = av_fetch(av, i, 0);
+        names.push_back(sv2v8str(name ? *name : &PL_sv_no));
+    }
+
+    ScriptOrigin script_origin(
+        origin ? sv2v8str(origin) : String::NewFromUtf8(isolate, "eval", v8::String::kNormalString)
+    );
+    ScriptCompiler::Source script_source(sv2v8str(body), script_origin);
+
+    Local<Function> fn;
+    if (!ScriptCompiler::CompileFunctionInContext(
+            local_context,
+            &script_source,
+            names.size(),
+            names.empty() ? NULL : &names[0],
+            0,
+            NULL
+        ).ToLocal(&fn)) {
+        set_perl_error(try_catch);
+        return &PL_sv_undef;
     }
+
+    sv_setsv(ERRSV, &PL_sv_undef);
+
+    return function2sv(fn);
+}
+
+void V8Context::register_script(V8Script* script) {
+    scripts.insert(script);
+}
+
+void V8Context::remove_script(V8Script* script) {
+    scripts.erase(script);
+}
+
+V8Script::V8Script(V8Context* context_, Handle<Script> script_)
+    : context(context_)
+    , script(context_->isolate, script_)
+{
+    context->register_script(this);
+}
+
+V8Script::~V8Script() {
+    if (context) context->remove_script(this);
+    script.Reset();
+}
+
+SV*
+V8Script::run() {
+    if (!context)
+        croak("Fatal error: V8 context is no more");
+
+    Isolate* isolate = context->isolate;
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope handle_scope(isolate);
+    TryCatch try_catch;
+    Context::Scope context_scope(context->get_local_context());
+
+    return context->run_script(script.Get(isolate), try_catch);
 }
 
 Handle<Value>
 V8Context::sv2v8(SV *sv, HandleMap& seen) {
     if (SvROK(sv))
         return rv2v8(sv, seen);
-    if (SvPOK(sv)) {
-        // Upgrade string to UTF-8 if needed
-        char *utf8 = SvPVutf8_nolen(sv);
-        return String::NewFromUtf8(isolate, utf8, v8::String::kNormalString);
+    if (SvRMAGICAL(sv)) {
+        // A buffer on its way back
+        ObjectData *data = sv_object_data(sv);
+        if (data && data->context == this && dynamic_cast<V8BufferData*>(data))
+            return data->object.Get(isolate);
     }
+    if (SvPOK(sv))
+        return sv2v8str(sv);
     if (SvUOK(sv)) {
         UV v = SvUV(sv);
         return (v < 0xffffffffUL) ? (Handle<Number>)Integer::NewFromUnsigned(isolate, v) : Number::New(isolate, SvNV(sv));
@@ -583,15 +2268,87 @@ V8Context::sv2v8(SV *sv, HandleMap& seen) {
 
 Handle<Value>
 V8Context::sv2v8(SV *sv) {
-    HandleMap seen;
+    if (bulk_threshold && SvROK(sv)) {
+        Handle<Value> value = sv2v8_bulk(sv);
+        if (!value.IsEmpty())
+            return value;
+    }
+
+    HandleMap seen(!acyclic);
     return sv2v8(sv, seen);
 }
 
+// True if no byte has its high bit set, 16 bytes at a time where SSE2 is
+// available and a word at a time elsewhere.
+static bool
+is_ascii(const char *s, STRLEN len) {
+    const char *end = s + len;
+
+#ifdef __SSE2__
+    for (; end - s >= 16; s += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)s)))
+            return false;
+    }
+#else
+    for (; end - s >= (ptrdiff_t)sizeof(UV); s += sizeof(UV)) {
+        UV word;
+        memcpy(&word, s, sizeof(word));
+        if (word & (UV_MAX / 0xff * 0x80))
+            return false;
+    }
+#endif
+
+    for (; s < end; s++) {
+        if (*s & 0x80)
+            return false;
+    }
+    return true;
+}
+
+// Byte strings are Latin-1 and so are UTF-8 ones holding nothing but
+// ASCII; both go to V8 as they are, without decoding, and large ones
+// without copying.
 Handle<String> V8Context::sv2v8str(SV* sv)
 {
-    // Upgrade string to UTF-8 if needed
-    char *utf8 = SvPVutf8_nolen(sv);
-    return String::NewFromUtf8(isolate, utf8, v8::String::kNormalString, SvCUR(sv));
+    STRLEN len;
+    const char *pv = SvPV(sv, len);
+
+    if (!SvUTF8(sv) || is_ascii(pv, len)) {
+        if (len >= EXTERNAL_STRING_MIN && !SvGMAGICAL(sv)) {
+            PerlStringResource *resource = new PerlStringResource(sv);
+            Local<String> str;
+            if (String::NewExternalOneByte(isolate, resource).ToLocal(&str))
+                return str;
+            resource->Dispose();
+        }
+        return String::NewFromOneByte(isolate, (const uint8_t*)pv, NewStringType::kNormal, len).FromMaybe(Local<String>());
+    }
+    return String::NewFromUtf8(isolate, pv, NewStringType::kNormal, len).FromMaybe(Local<String>());
+}
+
+// Strings V8 knows to be Latin-1 are written straight into a byte string;
+// anything else into a UTF-8 one, sized up front. Lone surrogates become
+// U+FFFD.
+SV* V8Context::str2sv(Handle<String> str)
+{
+    SV *sv;
+
+    if (str->ContainsOnlyOneByte()) {
+        int len = str->Length();
+        sv = newSV(len + 1);
+        str->WriteOneByte((uint8_t*)SvPVX(sv), 0, len, String::NO_NULL_TERMINATION);
+        SvCUR_set(sv, len);
+    } else {
+        int len = str->Utf8Length();
+        sv = newSV(len + 1);
+        len = str->WriteUtf8(SvPVX(sv), len, NULL, String::NO_NULL_TERMINATION | String::REPLACE_INVALID_UTF8);
+        SvCUR_set(sv, len);
+        SvUTF8_on(sv);
+    }
+
+    *SvEND(sv) = '\0';
+    SvPOK_on(sv);
+    return sv;
 }
 
 SV* V8Context::seen_v8(Handle<Object> object) {
@@ -607,6 +2364,10 @@ SV* V8Context::seen_v8(Handle<Object> object) {
     if (object->GetPrivate(context, privateKey).ToLocal(&value)) {
         ObjectData* data = (ObjectData*) value.As<v8::External>()->Value();
 
+        // materialize() wants copies of everything
+        if (materializing && dynamic_cast<V8ProxyData*>(data))
+            return NULL;
+
         return newRV(data->sv);
     }
 
@@ -630,12 +2391,14 @@ V8Context::v82sv(Handle<Value> value, SvMap& seen) {
     if (value->IsNumber())
         return newSVnv(value->NumberValue());
 
-    if (value->IsString()) {
-        String::Utf8Value str(value);
-        SV *sv = newSVpvn(*str, str.length());
-        sv_utf8_decode(sv);
-        return sv;
-    }
+    if (value->IsString())
+        return str2sv(Handle<String>::Cast(value));
+
+    if (value->IsArrayBuffer() || value->IsDataView() || value->IsUint8Array())
+        return buffer2sv(Handle<Object>::Cast(value));
+
+    if (value->IsTypedArray())
+        return typed2sv(Handle<TypedArray>::Cast(value));
 
     if (value->IsArray() || value->IsObject() || value->IsFunction()) {
         Handle<Object> object = value->ToObject();
@@ -648,6 +2411,11 @@ V8Context::v82sv(Handle<Value> value, SvMap& seen) {
             return function2sv(fn);
         }
 
+        if (futures && value->IsPromise() && gv_stashpvs("Future", 0)) {
+            if (SV *future = promise2future(Handle<Promise>::Cast(value)))
+                return future;
+        }
+
         if (SV* cached = seen.find(object))
             return cached;
 
@@ -668,7 +2436,16 @@ V8Context::v82sv(Handle<Value> value, SvMap& seen) {
 
 SV *
 V8Context::v82sv(Handle<Value> value) {
-    SvMap seen;
+    if (bulk_threshold && !lazy_results && !enable_blessing
+        && value->IsObject() && !value->IsFunction() && !value->IsDate() && !value->IsProxy() && !value->IsPromise()
+        && !value->IsArrayBuffer() && !value->IsArrayBufferView()) {
+        if (SV *cached = seen_v8(Handle<Object>::Cast(value)))
+            return cached;
+        if (SV *sv = v82sv_bulk(value))
+            return sv;
+    }
+
+    SvMap seen(!acyclic);
     return v82sv(value, seen);
 }
 
@@ -732,13 +2509,17 @@ V8Context::rv2v8(SV *rv, HandleMap& seen) {
     }
 
     {
-        HandleMap::const_iterator it = seen.find(ptr);
-        if (it != seen.end())
-            return it->second;
+        Handle<Value> found = seen.find(ptr);
+        if (!found.IsEmpty())
+            return found;
     }
 
 #if PERL_VERSION > 8
     if (SvOBJECT(sv)) {
+        if (sv_derived_from(rv, "Future")
+            || (gv_fetchmethod_autoload(SvSTASH(sv), "then", FALSE) && gv_fetchmethod_autoload(SvSTASH(sv), "catch", FALSE)))
+            return thenable2promise(rv);
+
         const char *Perl_class = sv_reftype(sv, 1);
         if ((0 == strcmp(Perl_class, "JSON::PP::Boolean"))
             || (0 == strcmp(Perl_class, "JSON::XS::Boolean"))
@@ -773,14 +2554,80 @@ V8Context::blessed2object(SV *sv) {
 }
 #endif
 
-Handle<Array>
+// With typed_arrays, arrays of nothing but numbers become an Int32Array if
+// every value fits, or a Float64Array otherwise. Strings, references and
+// undef rule it out; an empty handle means the array has to be converted
+// as usual.
+Handle<Object>
+V8Context::av2typed(AV *av, I32 len) {
+    SV **elements = AvARRAY(av);
+    bool ints = true;
+
+    for (I32 i = 0; i < len; i++) {
+        SV *sv = elements[i];
+        if (!sv || SvROK(sv) || SvPOK(sv) || SvGMAGICAL(sv) || !(SvIOK(sv) || SvNOK(sv)))
+            return Handle<Object>();
+        if (ints && !(SvIOK(sv) && !SvIsUV(sv) && SvIVX(sv) >= INT32_MIN && SvIVX(sv) <= INT32_MAX))
+            ints = false;
+    }
+
+    Handle<ArrayBuffer> buffer = ArrayBuffer::New(isolate, len * (ints ? sizeof(int32_t) : sizeof(double)));
+    void *data = buffer->GetContents().Data();
+
+    if (ints) {
+        int32_t *out = (int32_t*)data;
+        for (I32 i = 0; i < len; i++)
+            out[i] = (int32_t)SvIVX(elements[i]);
+        return Int32Array::New(buffer, 0, len);
+    }
+
+    double *out = (double*)data;
+    for (I32 i = 0; i < len; i++) {
+        SV *sv = elements[i];
+        out[i] = SvNOK(sv) ? SvNVX(sv) : SvIsUV(sv) ? (NV)SvUVX(sv) : (NV)SvIVX(sv);
+    }
+    return Float64Array::New(buffer, 0, len);
+}
+
+Handle<Object>
 V8Context::av2array(AV *av, HandleMap& seen, long ptr) {
     I32 i, len = av_len(av) + 1;
+    Local<Context> ctx = isolate->GetCurrentContext();
+
+    if (typed_arrays && len > 0 && !SvRMAGICAL(av)) {
+        Handle<Object> typed = av2typed(av, len);
+        if (!typed.IsEmpty()) {
+            seen.add(ptr, typed);
+            return typed;
+        }
+    }
+
+    // Arrays without references are filled by appending to an empty array,
+    // which keeps their elements packed where Array::New(isolate, len) would
+    // start out holey. Anything else has to be in seen before its elements
+    // are converted, in case they refer back to it--unless there are no
+    // cycles.
+    bool flat = len > 0 && !SvRMAGICAL(av);
+    for (i = 0; flat && !acyclic && i < len; i++) {
+        SV *sv = AvARRAY(av)[i];
+        flat = !sv || !SvROK(sv);
+    }
+
+    if (flat) {
+        Handle<Array> array = Array::New(isolate);
+        for (i = 0; i < len; i++) {
+            SV *sv = AvARRAY(av)[i];
+            array->Set(ctx, i, sv ? sv2v8(sv, seen) : Handle<Value>(Undefined(isolate))).IsJust();
+        }
+        seen.add(ptr, array);
+        return array;
+    }
+
     Handle<Array> array = Array::New(isolate, len);
-    seen[ptr] = array;
+    seen.add(ptr, array);
     for (i = 0; i < len; i++) {
         if (SV** sv = av_fetch(av, i, 0)) {
-            array->Set(Integer::New(isolate, i), sv2v8(*sv, seen));
+            array->Set(ctx, i, sv2v8(*sv, seen)).IsJust();
         }
     }
     return array;
@@ -788,19 +2635,159 @@ V8Context::av2array(AV *av, HandleMap& seen, long ptr) {
 
 Handle<Object>
 V8Context::hv2object(HV *hv, HandleMap& seen, long ptr) {
+    if (stable_shapes && !SvRMAGICAL(hv) && HvUSEDKEYS(hv) <= SHAPE_MAX_KEYS)
+        return hv2shaped(hv, seen, ptr);
+
     I32 len;
     char *key;
     SV *val;
 
     hv_iterinit(hv);
     Handle<Object> object = Object::New(isolate);
-    seen[ptr] = object;
+    seen.add(ptr, object);
     while (val = hv_iternextsv(hv, &key, &len)) {
         object->Set(v8::String::NewFromUtf8(isolate, key, v8::String::kNormalString), sv2v8(val, seen));
     }
     return object;
 }
 
+static bool
+he_less(HE *a, HE *b) {
+    int cmp = memcmp(HeKEY(a), HeKEY(b), min(HeKLEN(a), HeKLEN(b)));
+    return cmp ? cmp < 0 : HeKLEN(a) < HeKLEN(b);
+}
+
+static Handle<String>
+he_key(Isolate *isolate, HE *he) {
+    if (HeKUTF8(he))
+        return String::NewFromUtf8(isolate, HeKEY(he), NewStringType::kInternalized, HeKLEN(he)).ToLocalChecked();
+    return String::NewFromOneByte(isolate, (const uint8_t*)HeKEY(he), NewStringType::kInternalized, HeKLEN(he)).ToLocalChecked();
+}
+
+// Converts a hash with its keys in sorted order rather than Perl's
+// randomized one, so that equal key sets give objects of the same hidden
+// class. Each key set seen gets a cached template, up to SHAPE_CACHE_MAX of
+// them; hashes beyond that are still converted in sorted order.
+Handle<Object>
+V8Context::hv2shaped(HV *hv, HandleMap& seen, long ptr) {
+    Local<Context> ctx = isolate->GetCurrentContext();
+
+    vector<HE*> entries;
+    entries.reserve(HvUSEDKEYS(hv));
+    hv_iterinit(hv);
+    while (HE *he = hv_iternext(hv))
+        entries.push_back(he);
+    sort(entries.begin(), entries.end(), he_less);
+
+    string signature;
+    for (size_t i = 0; i < entries.size(); i++) {
+        I32 len = HeKLEN(entries[i]);
+        signature.append((const char*)&len, sizeof(len));
+        signature.append(HeKEY(entries[i]), len);
+        signature += HeKUTF8(entries[i]) ? '\1' : '\0';
+    }
+
+    ShapeMap::iterator shape = shapes.find(signature);
+    if (shape == shapes.end() && shapes.size() < SHAPE_CACHE_MAX) {
+        shape = shapes.insert(make_pair(signature, ObjectShape())).first;
+
+        Handle<ObjectTemplate> tmpl = ObjectTemplate::New(isolate);
+        for (size_t i = 0; i < entries.size(); i++) {
+            Handle<String> key = he_key(isolate, entries[i]);
+            tmpl->Set(key, Undefined(isolate));
+            shape->second.keys.push_back(Persistent<String, CopyablePersistentTraits<String>>(isolate, key));
+        }
+        shape->second.tmpl.Reset(isolate, tmpl);
+    }
+
+    bool cached = shape != shapes.end();
+    Handle<Object> object = cached
+        ? shape->second.tmpl.Get(isolate)->NewInstance(ctx).ToLocalChecked()
+        : Object::New(isolate);
+    seen.add(ptr, object);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        Handle<String> key = cached
+            ? shape->second.keys[i].Get(isolate)
+            : he_key(isolate, entries[i]);
+        object->CreateDataProperty(ctx, key, sv2v8(HeVAL(entries[i]), seen)).FromJust();
+    }
+    return object;
+}
+
+// Templates belong to the isolate rather than the JavaScript context, so
+// they are kept across reset() and only dropped with the V8Context.
+void
+V8Context::clear_shapes() {
+    for (ShapeMap::iterator it = shapes.begin(); it != shapes.end(); it++) {
+        it->second.tmpl.Reset();
+        for (size_t i = 0; i < it->second.keys.size(); i++)
+            it->second.keys[i].Reset();
+    }
+    shapes.clear();
+}
+
+// Like other templates, these belong to the isolate and outlive reset().
+Handle<ObjectTemplate>
+V8Context::view_template(bool array) {
+    Persistent<ObjectTemplate>& cached = array ? array_view : hash_view;
+
+    if (cached.IsEmpty()) {
+        Handle<ObjectTemplate> tmpl = ObjectTemplate::New(isolate);
+        tmpl->SetInternalFieldCount(1);
+
+        if (array) {
+            tmpl->SetHandler(NamedPropertyHandlerConfiguration(
+                PerlViewData::array_length, PerlViewData::array_set_length,
+                0, 0, 0, Handle<Value>(), PropertyHandlerFlags::kOnlyInterceptStrings
+            ));
+            tmpl->SetHandler(IndexedPropertyHandlerConfiguration(
+                PerlViewData::array_get, PerlViewData::array_set, PerlViewData::array_query,
+                PerlViewData::array_delete, PerlViewData::array_keys
+            ));
+        }
+        else {
+            tmpl->SetHandler(NamedPropertyHandlerConfiguration(
+                PerlViewData::hash_get, PerlViewData::hash_set, PerlViewData::hash_query,
+                PerlViewData::hash_delete, PerlViewData::hash_keys,
+                Handle<Value>(), PropertyHandlerFlags::kOnlyInterceptStrings
+            ));
+            tmpl->SetHandler(IndexedPropertyHandlerConfiguration(
+                PerlViewData::hash_get_index, PerlViewData::hash_set_index,
+                PerlViewData::hash_query_index, PerlViewData::hash_delete_index
+            ));
+        }
+
+        cached.Reset(isolate, tmpl);
+    }
+
+    return Local<ObjectTemplate>::New(isolate, cached);
+}
+
+// Arrays and hashes become live views of the Perl data, anything else is
+// converted as usual. Each array or hash gets one view per context.
+Handle<Value>
+V8Context::sv2view(SV *sv) {
+    if (!SvROK(sv) || SvOBJECT(SvRV(sv)))
+        return sv2v8(sv);
+
+    SV* target = SvRV(sv);
+    bool array = SvTYPE(target) == SVt_PVAV;
+    if (!array && SvTYPE(target) != SVt_PVHV)
+        return sv2v8(sv);
+
+    ObjectDataMap::iterator it = seen_perl.find(PTR2IV(target));
+    if (it != seen_perl.end())
+        return it->second->object.Get(isolate);
+
+    Local<Context> ctx = isolate->GetCurrentContext();
+    Handle<Object> object = view_template(array)->NewInstance(ctx).ToLocalChecked();
+    if (array)
+        object->SetPrototype(ctx, Array::New(isolate)->GetPrototype()).FromJust();
+
+    return (new PerlViewData(this, object, target))->object.Get(isolate);
+}
+
 Handle<Object>
 V8Context::cv2function(CV *cv) {
     return (new PerlFunctionData(this, (SV*)cv))->object.Get(isolate);
@@ -808,42 +2795,639 @@ V8Context::cv2function(CV *cv) {
 
 SV*
 V8Context::array2sv(Handle<Array> array, SvMap& seen) {
+    if (lazy_results && !materializing)
+        return object2proxy(array, true);
+
     AV *av = newAV();
     SV *rv = newRV_noinc((SV*)av);
 
-    seen.add(array, PTR2IV(av));
+    seen.add(array, (SV*)av);
+
+    Local<Context> ctx = isolate->GetCurrentContext();
+    uint32_t len = array->Length();
+    if (len)
+        av_extend(av, len - 1);
 
-    for (int i = 0; i < array->Length(); i++) {
-        Handle<Value> elementVal = array->Get( Integer::New( isolate, i ) );
-        av_push(av, v82sv(elementVal, seen));
+    for (uint32_t i = 0; i < len; i++) {
+        Local<Value> element;
+        if (!array->Get(ctx, i).ToLocal(&element))
+            element = Undefined(isolate);
+        av_push(av, v82sv(element, seen));
     }
     return rv;
 }
 
+// Numeric typed arrays become arrays of numbers, read straight from the
+// backing store (Uint8Arrays are byte strings; see buffer2sv).
+SV*
+V8Context::typed2sv(Handle<TypedArray> typed) {
+    AV *av = newAV();
+    SV *rv = newRV_noinc((SV*)av);
+    size_t len = typed->Length();
+
+    if (!len)
+        return rv;
+
+    char *data = (char*)typed->Buffer()->GetContents().Data() + typed->ByteOffset();
+    av_extend(av, len - 1);
+    SV **slots = AvARRAY(av);
+
+#define TYPED_COPY(type, make) \
+    for (size_t i = 0; i < len; i++) \
+        slots[i] = make(((type*)data)[i]);
+
+    if (typed->IsInt8Array())              { TYPED_COPY(int8_t, newSViv) }
+    else if (typed->IsUint8ClampedArray()) { TYPED_COPY(uint8_t, newSVuv) }
+    else if (typed->IsInt16Array())        { TYPED_COPY(int16_t, newSViv) }
+    else if (typed->IsUint16Array())       { TYPED_COPY(uint16_t, newSVuv) }
+    else if (typed->IsInt32Array())        { TYPED_COPY(int32_t, newSViv) }
+    else if (typed->IsUint32Array())       { TYPED_COPY(uint32_t, newSVuv) }
+    else if (typed->IsFloat32Array())      { TYPED_COPY(float, newSVnv) }
+    else if (typed->IsFloat64Array())      { TYPED_COPY(double, newSVnv) }
+    else {
+        // Slots own their values, so never the immortal undef
+        Local<Context> ctx = isolate->GetCurrentContext();
+        for (size_t i = 0; i < len; i++) {
+            Local<Value> element;
+            SV *sv = typed->Get(ctx, i).ToLocal(&element) ? v82sv(element) : NULL;
+            slots[i] = sv && sv != &PL_sv_undef ? sv : newSV(0);
+        }
+    }
+
+#undef TYPED_COPY
+
+    AvFILLp(av) = len - 1;
+    return rv;
+}
+
 SV *
 V8Context::object2sv(Handle<Object> obj, SvMap& seen) {
     if (enable_blessing && obj->Has(v8::String::NewFromUtf8(isolate, "__perlPackage", v8::String::kNormalString))) {
         return object2blessed(obj);
     }
 
+    if (lazy_results && !materializing)
+        return object2proxy(obj, false);
+
     HV *hv = newHV();
     SV *rv = newRV_noinc((SV*)hv);
 
-    seen.add(obj, PTR2IV(hv));
+    seen.add(obj, (SV*)hv);
+
+    Local<Context> ctx = isolate->GetCurrentContext();
+    Local<Array> properties;
+    if (!obj->GetOwnPropertyNames(ctx).ToLocal(&properties))
+        return rv;
+
+    uint32_t len = properties->Length();
+    hv_ksplit(hv, len);
+
+    for (uint32_t i = 0; i < len; i++) {
+        Local<Value> name, value;
+        if (!properties->Get(ctx, i).ToLocal(&name) || !obj->Get(ctx, name).ToLocal(&value))
+            continue;
+
+        // Array indices come as numbers. Converting one makes a new string
+        // each time, not an internalized one, so they skip the key cache.
+        if (!name->IsString()) {
+            String::Utf8Value utf8(name);
+            hv_store(hv, *utf8, utf8.length(), v82sv(value, seen), 0);
+            continue;
+        }
 
-    Local<Array> properties = obj->GetPropertyNames();
-    for (int i = 0; i < properties->Length(); i++) {
-        Local<Integer> propertyIndex = Integer::New( isolate, i );
-        Local<String> propertyName = Local<String>::Cast( properties->Get( propertyIndex ) );
-        String::Utf8Value propertyNameUTF8( propertyName );
+        Local<String> property = Local<String>::Cast(name);
+        SV *key = seen.find_key(property);
+        if (!key) {
+            String::Utf8Value utf8(property);
+            key = newSVpvn_share(*utf8, -utf8.length(), 0);
+            seen.add_key(property, key);
+        }
 
-        Local<Value> propertyValue = obj->Get( propertyName );
-        if (*propertyValue)
-            hv_store(hv, *propertyNameUTF8, 0 - propertyNameUTF8.length(), v82sv(propertyValue, seen), 0);
+        hv_store_ent(hv, key, v82sv(value, seen), SvSHARED_HASH(key));
     }
     return rv;
 }
 
+// Large plain data structures cross between Perl and JavaScript as JSON,
+// which V8 parses and prints natively and much faster than they can be
+// built or walked one value at a time through the API. Structures nested
+// deeper than this are converted the usual way.
+#define BULK_MAX_DEPTH 512
+
+static void
+json_string(string& out, const char *s, STRLEN len, bool utf8) {
+    out += '"';
+    for (STRLEN i = 0; i < len; i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else if (c >= 0x80 && !utf8) {
+            // Latin-1
+            out += (char)(0xc0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3f));
+        } else {
+            out += (char)c;
+        }
+    }
+    out += '"';
+}
+
+static void
+json_number(string& out, NV nv) {
+    char number[32];
+    snprintf(number, sizeof(number), "%.17g", nv);
+    out += number;
+}
+
+// Encodes a Perl value the way sv2v8() would convert it, counting the
+// values as it goes. Returns false for anything JSON cannot express
+// faithfully: undef, non-finite numbers, code refs, objects, magic, data
+// which is bound to JavaScript already and, unless acyclic is set, data
+// which is reached twice.
+bool
+V8Context::json_encode(SV *sv, string& out, IdentityMap<IV, bool>& seen, size_t& values, int depth) {
+    if (SvMAGICAL(sv))
+        return false;
+
+    values++;
+
+    if (!SvROK(sv)) {
+        if (SvPOK(sv)) {
+            json_string(out, SvPVX(sv), SvCUR(sv), SvUTF8(sv));
+        } else if (SvUOK(sv)) {
+            UV v = SvUV(sv);
+            if (v < 0xffffffffUL) {
+                char number[24];
+                snprintf(number, sizeof(number), "%lu", (unsigned long)v);
+                out += number;
+            } else {
+                json_number(out, SvNV(sv));
+            }
+        } else if (SvIOK(sv)) {
+            IV v = SvIV(sv);
+            if (v <= INT32_MAX && v >= INT32_MIN) {
+                char number[16];
+                snprintf(number, sizeof(number), "%d", (int)v);
+                out += number;
+            } else {
+                json_number(out, SvNV(sv));
+            }
+        } else if (SvNOK(sv)) {
+            NV nv = SvNV(sv);
+            if (Perl_isnan(nv) || Perl_isinf(nv))
+                return false;
+            json_number(out, nv);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    SV *ref = SvRV(sv);
+    IV ptr = PTR2IV(ref);
+    unsigned t = SvTYPE(ref);
+
+    if (SvOBJECT(ref) || SvMAGICAL(ref) || (t != SVt_PVAV && t != SVt_PVHV))
+        return false;
+    if (depth >= BULK_MAX_DEPTH || seen_perl.find(ptr) != seen_perl.end())
+        return false;
+    if (seen.enabled()) {
+        bool found;
+        if (seen.find(ptr_hash(ptr), ptr, found))
+            return false;
+        seen.add(ptr_hash(ptr), ptr, true);
+    }
+
+    if (t == SVt_PVAV) {
+        AV *av = (AV*)ref;
+        I32 len = av_len(av) + 1;
+        SV **elements = AvARRAY(av);
+
+        // These would become typed arrays
+        if (typed_arrays && len > 0) {
+            I32 i;
+            for (i = 0; i < len; i++) {
+                SV *e = elements[i];
+                if (!e || SvROK(e) || SvPOK(e) || !(SvIOK(e) || SvNOK(e)))
+                    break;
+            }
+            if (i == len)
+                return false;
+        }
+
+        out += '[';
+        for (I32 i = 0; i < len; i++) {
+            if (i)
+                out += ',';
+            if (!elements[i] || !json_encode(elements[i], out, seen, values, depth + 1))
+                return false;
+        }
+        out += ']';
+        return true;
+    }
+
+    HV *hv = (HV*)ref;
+    vector<HE*> entries;
+    HE *he;
+
+    entries.reserve(HvUSEDKEYS(hv));
+    hv_iterinit(hv);
+    while ((he = hv_iternext(hv)))
+        entries.push_back(he);
+    if (stable_shapes && entries.size() <= SHAPE_MAX_KEYS)
+        sort(entries.begin(), entries.end(), he_less);
+
+    out += '{';
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i)
+            out += ',';
+        json_string(out, HeKEY(entries[i]), HeKLEN(entries[i]), HeKUTF8(entries[i]));
+        out += ':';
+        if (!json_encode(HeVAL(entries[i]), out, seen, values, depth + 1))
+            return false;
+    }
+    out += '}';
+    return true;
+}
+
+// Counts values the way json_encode() does, but only up to limit, so data
+// too small to go through JSON is never encoded.
+static void
+count_values(SV *sv, size_t& values, size_t limit, int depth) {
+    if (++values >= limit || !SvROK(sv) || depth >= BULK_MAX_DEPTH)
+        return;
+
+    SV *ref = SvRV(sv);
+    if (SvMAGICAL(ref))
+        return;
+
+    if (SvTYPE(ref) == SVt_PVAV) {
+        AV *av = (AV*)ref;
+        I32 len = av_len(av) + 1;
+        SV **elements = AvARRAY(av);
+        for (I32 i = 0; i < len && values < limit; i++) {
+            if (elements[i])
+                count_values(elements[i], values, limit, depth + 1);
+        }
+    }
+    else if (SvTYPE(ref) == SVt_PVHV) {
+        HE *he;
+        hv_iterinit((HV*)ref);
+        while (values < limit && (he = hv_iternext((HV*)ref)))
+            count_values(HeVAL(he), values, limit, depth + 1);
+    }
+}
+
+// Returns an empty handle when the data should be converted the usual way.
+Handle<Value>
+V8Context::sv2v8_bulk(SV *sv) {
+    size_t values = 0;
+    count_values(sv, values, bulk_threshold, 0);
+    if (values < (size_t)bulk_threshold) {
+        direct_to_js++;
+        return Handle<Value>();
+    }
+
+    IdentityMap<IV, bool> seen(!acyclic);
+    string json;
+
+    values = 0;
+    if (!json_encode(sv, json, seen, values, 0)) {
+        bulk_bailouts++;
+        return Handle<Value>();
+    }
+
+    Local<Context> ctx = isolate->GetCurrentContext();
+    Local<String> source;
+    Local<Value> value;
+    if (!String::NewFromUtf8(isolate, json.data(), NewStringType::kNormal, json.length()).ToLocal(&source)
+        || !JSON::Parse(ctx, source).ToLocal(&value)) {
+        bulk_bailouts++;
+        return Handle<Value>();
+    }
+
+    bulk_to_js++;
+    return value;
+}
+
+// Reads JSON printed by V8, which is known to be well-formed, into Perl
+// values the way v82sv() would convert the equivalent JavaScript ones.
+class JsonReader {
+    const char *p;
+    const char *end;
+
+    void skip_space() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    unsigned hex4() {
+        unsigned code = 0;
+        for (int i = 0; i < 4 && p < end; i++, p++) {
+            char c = *p;
+            code = code * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        }
+        return code;
+    }
+
+    static void put_utf8(string& out, unsigned code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xc0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += (char)(0xe0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        } else {
+            out += (char)(0xf0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3f));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+    }
+
+    // Leaves the UTF-8 bytes of a string in out, and p after its closing
+    // quote. Lone surrogates become U+FFFD, as they do in v82sv().
+    bool read_string(string& out, bool& wide) {
+        p++;
+        wide = false;
+        while (p < end && *p != '"') {
+            const char *run = p;
+            while (p < end && *p != '"' && *p != '\\')
+                p++;
+            for (const char *c = run; c < p; c++)
+                wide = wide || (unsigned char)*c >= 0x80;
+            out.append(run, p - run);
+            if (p >= end || *p == '"')
+                break;
+
+            p++;
+            if (p >= end)
+                return false;
+            char c = *p++;
+            switch (c) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned code = hex4();
+                if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    const char *low = p;
+                    p += 2;
+                    unsigned next = hex4();
+                    if (next >= 0xdc00 && next < 0xe000)
+                        code = 0x10000 + ((code - 0xd800) << 10) + (next - 0xdc00);
+                    else
+                        p = low;
+                }
+                if (code >= 0xd800 && code < 0xe000)
+                    code = 0xfffd;
+                wide = wide || code >= 0x80;
+                put_utf8(out, code);
+                break;
+            }
+            default: out += c; break;
+            }
+        }
+        if (p >= end)
+            return false;
+        p++;
+        return true;
+    }
+
+    SV* read_number() {
+        const char *start = p;
+        bool integer = true;
+        while (p < end && strchr("+-0123456789.eE", *p)) {
+            if (*p == '.' || *p == 'e' || *p == 'E')
+                integer = false;
+            p++;
+        }
+
+        string number(start, p - start);
+        if (integer && p - start < 12) {
+            long v = strtol(number.c_str(), NULL, 10);
+            if (v <= INT32_MAX && v >= INT32_MIN)
+                return newSViv(v);
+        }
+        return newSVnv(strtod(number.c_str(), NULL));
+    }
+
+public:
+    JsonReader(const char *json, size_t length)
+        : p(json), end(json + length) { }
+
+    // Returns NULL if the JSON ends early or nests too deeply.
+    SV* read(int depth) {
+        skip_space();
+        if (p >= end || depth > BULK_MAX_DEPTH)
+            return NULL;
+
+        switch (*p) {
+        case '"': {
+            string bytes;
+            bool wide;
+            if (!read_string(bytes, wide))
+                return NULL;
+            SV *sv = newSVpvn(bytes.data(), bytes.length());
+            if (wide)
+                SvUTF8_on(sv);
+            return sv;
+        }
+        case 't':
+            p += 4;
+            return newSVuv(1);
+        case 'f':
+            p += 5;
+            return newSVuv(0);
+        case 'n':
+            p += 4;
+            return newSV(0);
+        case '[': {
+            AV *av = newAV();
+            SV *rv = newRV_noinc((SV*)av);
+            p++;
+            skip_space();
+            while (p < end && *p != ']') {
+                SV *element = read(depth + 1);
+                if (!element) {
+                    SvREFCNT_dec(rv);
+                    return NULL;
+                }
+                av_push(av, element);
+                skip_space();
+                if (p < end && *p == ',')
+                    p++;
+            }
+            p++;
+            return rv;
+        }
+        case '{': {
+            HV *hv = newHV();
+            SV *rv = newRV_noinc((SV*)hv);
+            p++;
+            skip_space();
+            while (p < end && *p == '"') {
+                string key;
+                bool wide;
+                if (!read_string(key, wide)) {
+                    SvREFCNT_dec(rv);
+                    return NULL;
+                }
+                skip_space();
+                p++; // ':'
+                SV *value = read(depth + 1);
+                if (!value) {
+                    SvREFCNT_dec(rv);
+                    return NULL;
+                }
+                hv_store(hv, key.data(), wide ? -(I32)key.length() : (I32)key.length(), value, 0);
+                skip_space();
+                if (p < end && *p == ',')
+                    p++;
+                skip_space();
+            }
+            p++;
+            return rv;
+        }
+        default:
+            return read_number();
+        }
+    }
+};
+
+struct JsonWalk {
+    IdentityMap<Handle<Object>, bool> seen;
+    Local<Value> object_prototype;
+    Local<Value> array_prototype;
+    Local<String> to_json;
+    size_t values;
+
+    JsonWalk(bool track_cycles) : seen(track_cycles), values(0) { }
+};
+
+// True if JSON::Stringify() prints exactly what v82sv() would return for
+// the value: only plain objects and arrays which Perl doesn't hold yet,
+// finite numbers other than -0, and no undefined properties, accessors or
+// toJSON methods. Unless acyclic is set, an object reached twice fails too,
+// since JSON would copy it. Reads every property once, and counts values.
+bool
+V8Context::json_plain(Handle<Value> value, JsonWalk& walk, int depth) {
+    walk.values++;
+
+    if (value->IsString() || value->IsBoolean() || value->IsNull() || value->IsInt32())
+        return true;
+    if (value->IsNumber()) {
+        double n = value->NumberValue();
+        return !Perl_isnan(n) && !Perl_isinf(n) && !(n == 0 && signbit(n));
+    }
+    if (!value->IsObject() || value->IsProxy() || depth >= BULK_MAX_DEPTH)
+        return false;
+
+    Local<Context> ctx = isolate->GetCurrentContext();
+    Handle<Object> obj = Handle<Object>::Cast(value);
+    bool array = value->IsArray();
+
+    // Dates, typed arrays, maps, functions and class instances all have
+    // prototypes of their own
+    if (obj->InternalFieldCount() || seen_v8(obj))
+        return false;
+    Local<Value> prototype = obj->GetPrototype();
+    if (array ? prototype != walk.array_prototype : !(prototype == walk.object_prototype || prototype->IsNull()))
+        return false;
+
+    if (walk.seen.enabled()) {
+        bool found;
+        if (walk.seen.find(obj->GetIdentityHash(), obj, found))
+            return false;
+        walk.seen.add(obj->GetIdentityHash(), obj, true);
+    }
+
+    if (array) {
+        Handle<Array> list = Handle<Array>::Cast(obj);
+        uint32_t len = list->Length();
+        for (uint32_t i = 0; i < len; i++) {
+            Local<Value> element;
+            if (!list->Get(ctx, i).ToLocal(&element) || !(element->IsUndefined() || json_plain(element, walk, depth + 1)))
+                return false;
+        }
+        return true;
+    }
+
+    Local<Array> properties;
+    if (!obj->GetOwnPropertyNames(ctx).ToLocal(&properties))
+        return false;
+
+    uint32_t len = properties->Length();
+    for (uint32_t i = 0; i < len; i++) {
+        Local<Value> name, property;
+        if (!properties->Get(ctx, i).ToLocal(&name))
+            return false;
+
+        Local<String> key = name->IsString() ? Local<String>::Cast(name) : name->ToString();
+        if (key->StrictEquals(walk.to_json) || obj->HasRealNamedCallbackProperty(ctx, key).FromMaybe(true))
+            return false;
+        if (!obj->Get(ctx, key).ToLocal(&property) || property->IsUndefined() || !json_plain(property, walk, depth + 1))
+            return false;
+    }
+    return true;
+}
+
+// Returns NULL when the value should be converted the usual way.
+SV*
+V8Context::v82sv_bulk(Handle<Value> value) {
+    Local<Context> ctx = isolate->GetCurrentContext();
+    Local<String> json;
+
+    {
+        TryCatch try_catch(isolate);
+        JsonWalk walk(!acyclic);
+        walk.object_prototype = Object::New(isolate)->GetPrototype();
+        walk.array_prototype = Array::New(isolate)->GetPrototype();
+        walk.to_json = String::NewFromUtf8(isolate, "toJSON", NewStringType::kInternalized).ToLocalChecked();
+
+        // Somebody could give every object a toJSON method
+        if (Handle<Object>::Cast(walk.object_prototype)->Has(ctx, walk.to_json).FromMaybe(true)
+            || Handle<Object>::Cast(walk.array_prototype)->Has(ctx, walk.to_json).FromMaybe(true)
+            || !json_plain(value, walk, 0)) {
+            bulk_bailouts++;
+            return NULL;
+        }
+        if (walk.values < (size_t)bulk_threshold) {
+            direct_to_perl++;
+            return NULL;
+        }
+
+        if (!JSON::Stringify(ctx, value).ToLocal(&json)) {
+            bulk_bailouts++;
+            return NULL;
+        }
+    }
+
+    String::Utf8Value utf8(json);
+    const char *s = *utf8;
+    size_t length = utf8.length();
+
+    JsonReader reader(s, length);
+    SV *sv = reader.read(0);
+    if (!sv) {
+        bulk_bailouts++;
+        return NULL;
+    }
+
+    bulk_to_perl++;
+    return sv;
+}
+
 static void
 my_gv_setsv(pTHX_ GV* const gv, SV* const sv){
     ENTER;
@@ -870,14 +3454,17 @@ my_gv_setsv(pTHX_ GV* const gv, SV* const sv){
         /* We have to do all this inside a block so that all the proper \
          * destructors are called if we need to croak. If we just croak in the \
          * middle of the block, v8 will segfault at program exit. */ \
-        Isolate::Scope  isolate_scope(isolate); \
-        HandleScope     scope(isolate); \
-        TryCatch        try_catch; \
         V8FunctionData* data = (V8FunctionData*)sv_object_data((SV*)cv); \
         if (data->context) { \
         V8Context      *self = data->context; \
+        Isolate        *isolate = self->isolate; \
+        Isolate::Scope  isolate_scope(isolate); \
+        HandleScope     scope(isolate); \
+        TryCatch        try_catch; \
         Handle<Context> ctx  = self->context.Get(isolate); \
         Context::Scope  context_scope(ctx); \
+        js_call         call; \
+        MicrotasksScope microtasks(isolate, self->microtasks_scope()); \
         vector<Handle<Value> > argv; \
 \
         for (I32 i = ARGS_OFFSET; i < items; i++) { \
@@ -885,8 +3472,9 @@ my_gv_setsv(pTHX_ GV* const gv, SV* const sv){
         }
 
 #define CONVERT_V8_RESULT(POP) \
+        self->queued_microtasks(); \
         if (try_catch.HasCaught()) { \
-            set_perl_error(try_catch); \
+            self->set_call_error(try_catch); \
             die = true; \
         } \
         else { \
@@ -908,7 +3496,97 @@ my_gv_setsv(pTHX_ GV* const gv, SV* const sv){
             } \
         } \
         } \
-        else {\
+        else {\
+            die = true; \
+            sv_setpv(ERRSV, "Fatal error: V8 context is no more"); \
+            sv_utf8_upgrade(ERRSV); \
+        } \
+    } \
+\
+    if (die) \
+        croak(NULL); \
+\
+XSRETURN(count);
+
+XS(v8closure) {
+    SETUP_V8_CALL(0)
+    Handle<Value> result = Handle<Function>::Cast(data->object.Get(isolate))->Call(ctx->Global(), items, &argv[0]);
+    CONVERT_V8_RESULT()
+}
+
+XS(v8method) {
+    SETUP_V8_CALL(1)
+    V8ObjectData* This = (V8ObjectData*)SvIV((SV*)SvRV(ST(0)));
+    Handle<Value> result = Handle<Function>::Cast(data->object.Get(isolate))->Call(This->object.Get(isolate), items - 1, &argv[0]);
+    CONVERT_V8_RESULT(POPs);
+}
+
+XS(v8settle) {
+    dXSARGS;
+
+    {
+        V8ResolverData* data = (V8ResolverData*)sv_object_data((SV*)cv);
+        if (data->context) {
+            V8Context      *self = data->context;
+            Isolate        *isolate = self->isolate;
+            Isolate::Scope  isolate_scope(isolate);
+            HandleScope     scope(isolate);
+            TryCatch        try_catch;
+            Handle<Context> ctx = self->context.Get(isolate);
+            Context::Scope  context_scope(ctx);
+            MicrotasksScope microtasks(isolate, self->microtasks_scope());
+
+            Handle<Promise::Resolver> resolver = Handle<Promise::Resolver>::Cast(data->object.Get(isolate));
+            Handle<Value> value = items ? self->sv2v8(ST(0)) : (Handle<Value>)Undefined(isolate);
+
+            if (data->reject)
+                resolver->Reject(ctx, value).IsJust();
+            else
+                resolver->Resolve(ctx, value).IsJust();
+            self->queued_microtasks();
+        }
+    }
+
+    XSRETURN_EMPTY;
+}
+
+static V8ProxyData*
+proxy_data(SV* tie) {
+    if (!SvROK(tie) || !SvROK(SvRV(tie)))
+        return NULL;
+
+    V8ProxyData* data = (V8ProxyData*)sv_object_data(SvRV(SvRV(tie)));
+    return data && data->context ? data : NULL;
+}
+
+#define SETUP_PROXY_CALL \
+    DVAR \
+    dXSARGS; \
+\
+    bool die = false; \
+    SV* result = &PL_sv_undef; \
+\
+    { \
+        V8ProxyData* data = proxy_data(ST(0)); \
+        if (data) { \
+        V8Context      *self = data->context; \
+        Isolate        *isolate = self->isolate; \
+        Isolate::Scope  isolate_scope(isolate); \
+        HandleScope     scope(isolate); \
+        TryCatch        try_catch; \
+        Handle<Context> ctx  = self->context.Get(isolate); \
+        Context::Scope  context_scope(ctx); \
+        js_call         call; \
+        MicrotasksScope microtasks(isolate, self->microtasks_scope()); \
+        Handle<Object>  object = data->object.Get(isolate);
+
+#define FINISH_PROXY_CALL \
+        if (try_catch.HasCaught()) { \
+            self->set_call_error(try_catch); \
+            die = true; \
+        } \
+        } \
+        else { \
             die = true; \
             sv_setpv(ERRSV, "Fatal error: V8 context is no more"); \
             sv_utf8_upgrade(ERRSV); \
@@ -918,19 +3596,149 @@ my_gv_setsv(pTHX_ GV* const gv, SV* const sv){
     if (die) \
         croak(NULL); \
 \
-XSRETURN(count);
+    ST(0) = result; \
+XSRETURN(1);
+
+#define PROXY_LENGTH String::NewFromUtf8(isolate, "length", v8::String::kNormalString)
+
+// Hash keys and array indexes both go through sv2v8, which turns an
+// index into an Integer and so into an element access.
+XS(v8proxy_fetch) {
+    SETUP_PROXY_CALL
+    Local<Value> value;
+    if (object->Get(ctx, self->sv2v8(ST(1))).ToLocal(&value))
+        result = sv_2mortal(self->v82sv(value));
+    FINISH_PROXY_CALL
+}
 
-XS(v8closure) {
-    SETUP_V8_CALL(0)
-    Handle<Value> result = Handle<Function>::Cast(data->object.Get(isolate))->Call(ctx->Global(), items, &argv[0]);
-    CONVERT_V8_RESULT()
+XS(v8proxy_store) {
+    SETUP_PROXY_CALL
+    object->Set(ctx, self->sv2v8(ST(1)), self->sv2v8(ST(2))).IsJust();
+    FINISH_PROXY_CALL
 }
 
-XS(v8method) {
-    SETUP_V8_CALL(1)
-    V8ObjectData* This = (V8ObjectData*)SvIV((SV*)SvRV(ST(0)));
-    Handle<Value> result = Handle<Function>::Cast(data->object.Get(isolate))->Call(This->object.Get(isolate), items - 1, &argv[0]);
-    CONVERT_V8_RESULT(POPs);
+XS(v8proxy_exists) {
+    SETUP_PROXY_CALL
+    result = boolSV(object->Has(ctx, self->sv2v8(ST(1))).FromMaybe(false));
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_delete) {
+    SETUP_PROXY_CALL
+    Handle<Value> key = self->sv2v8(ST(1));
+    Local<Value> value;
+    if (object->Get(ctx, key).ToLocal(&value)) {
+        result = sv_2mortal(self->v82sv(value));
+        object->Delete(ctx, key).IsJust();
+    }
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_nextkey) {
+    SETUP_PROXY_CALL
+    Local<Array> keys = data->keys.Get(isolate);
+    Local<Value> key;
+    if (!keys.IsEmpty() && data->next_key < keys->Length() && keys->Get(ctx, data->next_key++).ToLocal(&key))
+        result = sv_2mortal(self->v82sv(key));
+    else
+        data->keys.Reset();
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_firstkey) {
+    SETUP_PROXY_CALL
+    Local<Array> keys;
+    if (object->GetOwnPropertyNames(ctx).ToLocal(&keys)) {
+        data->keys.Reset(isolate, keys);
+        data->next_key = 0;
+        Local<Value> key;
+        if (keys->Length() && keys->Get(ctx, data->next_key++).ToLocal(&key))
+            result = sv_2mortal(self->v82sv(key));
+    }
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_scalar) {
+    SETUP_PROXY_CALL
+    Local<Array> keys;
+    if (object->GetOwnPropertyNames(ctx).ToLocal(&keys))
+        result = sv_2mortal(newSVuv(keys->Length()));
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_fetchsize) {
+    SETUP_PROXY_CALL
+    Local<Value> length;
+    if (object->Get(ctx, PROXY_LENGTH).ToLocal(&length))
+        result = sv_2mortal(newSVuv(length->Uint32Value()));
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_storesize) {
+    SETUP_PROXY_CALL
+    object->Set(ctx, PROXY_LENGTH, self->sv2v8(ST(1))).IsJust();
+    FINISH_PROXY_CALL
+}
+
+XS(v8proxy_materialize) {
+    SETUP_PROXY_CALL
+    result = sv_2mortal(self->materialize(object));
+    FINISH_PROXY_CALL
+}
+
+// The rest of the tie interface (CLEAR, PUSH, SPLICE, ...) is inherited
+// from Tie::Hash and Tie::Array; see JavaScript/V8/Context.pm.
+static void
+install_proxy_methods() {
+    static bool installed = false;
+    if (installed)
+        return;
+    installed = true;
+
+    const char* packages[] = { "JavaScript::V8::Object", "JavaScript::V8::Array" };
+    for (int i = 0; i < 2; i++) {
+        string package(packages[i]);
+        newXS((package + "::FETCH").c_str(), v8proxy_fetch, __FILE__);
+        newXS((package + "::STORE").c_str(), v8proxy_store, __FILE__);
+        newXS((package + "::EXISTS").c_str(), v8proxy_exists, __FILE__);
+        newXS((package + "::DELETE").c_str(), v8proxy_delete, __FILE__);
+        newXS((package + "::materialize").c_str(), v8proxy_materialize, __FILE__);
+    }
+    newXS("JavaScript::V8::Object::FIRSTKEY", v8proxy_firstkey, __FILE__);
+    newXS("JavaScript::V8::Object::NEXTKEY", v8proxy_nextkey, __FILE__);
+    newXS("JavaScript::V8::Object::SCALAR", v8proxy_scalar, __FILE__);
+    newXS("JavaScript::V8::Array::FETCHSIZE", v8proxy_fetchsize, __FILE__);
+    newXS("JavaScript::V8::Array::STORESIZE", v8proxy_storesize, __FILE__);
+}
+
+SV*
+V8Context::object2proxy(Handle<Object> obj, bool array) {
+    SV *container = array ? (SV*)newAV() : (SV*)newHV();
+    SV *rv = newRV_noinc(container);
+
+    new V8ProxyData(this, obj, container);
+
+    SV *weak = newRV_inc(container);
+    sv_rvweaken(weak);
+    SV *tie = sv_bless(
+        newRV_noinc(weak),
+        gv_stashpv(array ? "JavaScript::V8::Array" : "JavaScript::V8::Object", GV_ADD)
+    );
+    sv_magic(container, tie, PERL_MAGIC_tied, NULL, 0);
+    SvREFCNT_dec(tie); // refcnt is incremented by sv_magic
+
+    return rv;
+}
+
+SV*
+V8Context::materialize(Handle<Object> object) {
+    SvMap seen(!acyclic);
+    materializing = true;
+    SV *sv = object->IsArray()
+        ? array2sv(Handle<Array>::Cast(object), seen)
+        : object2sv(object, seen);
+    materializing = false;
+    return sv;
 }
 
 SV*
@@ -940,6 +3748,186 @@ V8Context::function2sv(Handle<Function> fn) {
     return newRV_noinc((SV*)code);
 }
 
+// Promises come back as a Future settled by the promise's reactions, when
+// the context was created with futures and the Future module is loaded; the
+// function returns NULL if it can't make one.
+SV*
+V8Context::promise2future(Handle<Promise> promise) {
+    Local<Context> ctx = isolate->GetCurrentContext();
+    SV *future = NULL, *done = NULL, *fail = NULL;
+    int count;
+
+    dSP;
+    ENTER;
+    SAVETMPS;
+
+    PUSHMARK(SP);
+    XPUSHs(sv_2mortal(newSVpvs("Future")));
+    PUTBACK;
+    count = call_method("new", G_SCALAR | G_EVAL);
+    SPAGAIN;
+    if (count == 1 && !SvTRUE(ERRSV))
+        future = newSVsv(POPs);
+    PUTBACK;
+
+    const char* methods[] = { "done_cb", "fail_cb" };
+    SV** callbacks[] = { &done, &fail };
+    for (int i = 0; future && i < 2; i++) {
+        PUSHMARK(SP);
+        XPUSHs(future);
+        PUTBACK;
+        count = call_method(methods[i], G_SCALAR | G_EVAL);
+        SPAGAIN;
+        if (count == 1 && !SvTRUE(ERRSV))
+            *callbacks[i] = newSVsv(POPs);
+        PUTBACK;
+    }
+
+    FREETMPS;
+    LEAVE;
+
+    if (!done || !fail) {
+        SvREFCNT_dec(future);
+        SvREFCNT_dec(done);
+        SvREFCNT_dec(fail);
+        return NULL;
+    }
+
+    // Catch on the promise Then returns, so a rejection is always handled
+    Local<Promise> chained;
+    if (promise->Then(ctx, Handle<Function>::Cast(sv2v8(done))).ToLocal(&chained))
+        chained->Catch(ctx, Handle<Function>::Cast(sv2v8(fail))).IsEmpty();
+    SvREFCNT_dec(done);
+    SvREFCNT_dec(fail);
+
+    return future;
+}
+
+// Futures and other Perl promises (anything which can then() and catch())
+// become a native promise, settled from the Perl side's callbacks. A
+// future resolves the promise with its first value.
+Handle<Value>
+V8Context::thenable2promise(SV *rv) {
+    Local<Context> ctx = isolate->GetCurrentContext();
+    Local<Promise::Resolver> resolver;
+    if (!Promise::Resolver::New(ctx).ToLocal(&resolver))
+        return Undefined(isolate);
+
+    CV *resolve = newXS(NULL, v8settle, __FILE__);
+    new V8ResolverData(this, resolver, (SV*)resolve, false);
+    CV *reject = newXS(NULL, v8settle, __FILE__);
+    new V8ResolverData(this, resolver, (SV*)reject, true);
+
+    bool future = sv_derived_from(rv, "Future");
+
+    dSP;
+    ENTER;
+    SAVETMPS;
+
+    PUSHMARK(SP);
+    XPUSHs(rv);
+    mXPUSHs(newRV_noinc((SV*)resolve));
+    if (!future)
+        mXPUSHs(newRV_noinc((SV*)reject));
+    PUTBACK;
+    call_method(future ? "on_done" : "then", G_DISCARD | G_EVAL);
+
+    if (future && !SvTRUE(ERRSV)) {
+        SPAGAIN;
+        PUSHMARK(SP);
+        XPUSHs(rv);
+        mXPUSHs(newRV_noinc((SV*)reject));
+        PUTBACK;
+        call_method("on_fail", G_DISCARD | G_EVAL);
+    }
+    else if (future) {
+        SvREFCNT_dec(reject);
+    }
+
+    if (SvTRUE(ERRSV))
+        resolver->Reject(ctx, sv2v8(ERRSV)).IsJust();
+
+    FREETMPS;
+    LEAVE;
+
+    return resolver->GetPromise();
+}
+
+// Views share their buffer's backing store; asking for the buffer moves
+// small typed arrays off the V8 heap, so the pointer stays put. Perl wants
+// a NUL after the string, which the allocator leaves after every buffer
+// (and Perl after bound strings), so views stopping short of the end of
+// their buffer are copied instead.
+SV*
+V8Context::buffer2sv(Handle<Object> obj) {
+    Handle<ArrayBuffer> buffer;
+    size_t offset = 0, length;
+
+    if (obj->IsArrayBuffer()) {
+        buffer = Handle<ArrayBuffer>::Cast(obj);
+        length = buffer->ByteLength();
+    }
+    else {
+        Handle<ArrayBufferView> view = Handle<ArrayBufferView>::Cast(obj);
+        buffer = view->Buffer();
+        offset = view->ByteOffset();
+        length = view->ByteLength();
+    }
+
+    char *data = (char*)buffer->GetContents().Data() + offset;
+    if (offset + length < buffer->ByteLength())
+        return newSVpvn(data, length);
+
+    SV *sv = newSV(0);
+    new V8BufferData(this, obj, sv, data, length);
+    return sv;
+}
+
+// Takes the contents of an ArrayBuffer so they can move to another isolate,
+// leaving the buffer neutered. Contents V8 doesn't own (bind_buffer's) are
+// copied instead.
+static bool
+take_buffer(Handle<ArrayBuffer> buffer, void*& data, size_t& length) {
+    if (!buffer->IsNeuterable())
+        return false;
+
+    length = buffer->ByteLength();
+    if (buffer->IsExternal()) {
+        data = malloc(length + 1);
+        memcpy(data, buffer->GetContents().Data(), length);
+        ((char*)data)[length] = '\0';
+    }
+    else {
+        data = buffer->Externalize().Data();
+    }
+
+    buffer->Neuter();
+    return true;
+}
+
+// Byte strings returned for the buffer or its views share its contents, so
+// they are emptied before the contents move.
+bool
+V8Context::transfer_buffer(Handle<ArrayBuffer> buffer, void*& data, size_t& length) {
+    if (!buffer->IsNeuterable())
+        return false;
+
+    for (ObjectDataMap::iterator it = seen_perl.begin(); it != seen_perl.end(); it++) {
+        V8BufferData* bytes = dynamic_cast<V8BufferData*>(it->second);
+        if (!bytes || bytes->context != this)
+            continue;
+
+        Local<Object> obj = Local<Object>::New(isolate, bytes->object);
+        Local<ArrayBuffer> shared = obj->IsArrayBuffer()
+            ? Local<ArrayBuffer>::Cast(obj)
+            : Local<ArrayBufferView>::Cast(obj)->Buffer();
+        if (shared == buffer)
+            bytes->detach();
+    }
+
+    return take_buffer(buffer, data, length);
+}
+
 SV*
 V8Context::object2blessed(Handle<Object> obj) {
     char package[128];
@@ -991,28 +3979,490 @@ V8Context::object2blessed(Handle<Object> obj) {
 
 bool
 V8Context::idle_notification() {
-    /*
-    HeapStatistics hs;
-    V8::GetHeapStatistics(&hs);
-    L(
-        "%d %d %d\n",
-        hs.total_heap_size(),
-        hs.total_heap_size_executable(),
-        hs.used_heap_size()
-    );
-    */
-
     isolate->LowMemoryNotification(); // force garbage collection
 
     return true;
 }
 
-int
-V8Context::adjust_amount_of_external_allocated_memory(int change_in_bytes) {
-    //return V8::AdjustAmountOfExternalAllocatedMemory(change_in_bytes);
+SV*
+V8Context::heap_statistics() {
+    HeapStatistics hs;
+    isolate->GetHeapStatistics(&hs);
+
+    HV* hv = newHV();
+
+    hv_stores(hv, "total_heap_size", newSVuv(hs.total_heap_size()));
+    hv_stores(hv, "total_heap_size_executable", newSVuv(hs.total_heap_size_executable()));
+    hv_stores(hv, "total_physical_size", newSVuv(hs.total_physical_size()));
+    hv_stores(hv, "total_available_size", newSVuv(hs.total_available_size()));
+    hv_stores(hv, "used_heap_size", newSVuv(hs.used_heap_size()));
+    hv_stores(hv, "heap_size_limit", newSVuv(hs.heap_size_limit()));
+    hv_stores(hv, "malloced_memory", newSVuv(hs.malloced_memory()));
+    hv_stores(hv, "peak_malloced_memory", newSVuv(hs.peak_malloced_memory()));
+    // Adjusting by nothing just returns the current amount
+    hv_stores(hv, "external_memory", newSVnv(isolate->AdjustAmountOfExternalAllocatedMemory(0)));
+
+    // These belong to this context rather than the isolate
+    hv_stores(hv, "wrapped_objects", newSVuv(seen_perl.size()));
+    hv_stores(hv, "cached_prototypes", newSVuv(prototypes.size()));
+    hv_stores(hv, "cached_shapes", newSVuv(shapes.size()));
+
+    return newRV_noinc((SV*)hv);
+}
+
+SV*
+V8Context::heap_space_statistics() {
+    HV* hv = newHV();
+
+    for (size_t i = 0; i < isolate->NumberOfHeapSpaces(); i++) {
+        HeapSpaceStatistics ss;
+        if (!isolate->GetHeapSpaceStatistics(&ss, i))
+            continue;
+
+        HV* space = newHV();
+        hv_stores(space, "space_size", newSVuv(ss.space_size()));
+        hv_stores(space, "space_used_size", newSVuv(ss.space_used_size()));
+        hv_stores(space, "space_available_size", newSVuv(ss.space_available_size()));
+        hv_stores(space, "physical_space_size", newSVuv(ss.physical_space_size()));
+
+        hv_store(hv, ss.space_name(), strlen(ss.space_name()), newRV_noinc((SV*)space), 0);
+    }
+
+    return newRV_noinc((SV*)hv);
+}
+
+IV
+V8Context::adjust_amount_of_external_allocated_memory(IV change_in_bytes) {
+    return isolate->AdjustAmountOfExternalAllocatedMemory(change_in_bytes);
 }
 
 void
 V8Context::set_flags_from_string(char *str) {
-    V8::SetFlagsFromString(str, strlen(str));
+    set_v8_flags(str);
+}
+
+// V8Worker class starts here
+
+V8Worker::Message::~Message() {
+    free(data);
+    for (size_t i = 0; i < buffers.size(); i++)
+        free(buffers[i].data);
+}
+
+class CloneDelegate : public ValueSerializer::Delegate {
+    Isolate* isolate;
+
+public:
+    CloneDelegate(Isolate* isolate_) : isolate(isolate_) { }
+
+    virtual void ThrowDataCloneError(Local<String> message) {
+        isolate->ThrowException(Exception::Error(message));
+    }
+};
+
+// Returns NULL with an exception pending if the value can't be cloned or a
+// buffer can't be transferred. The host's buffers go through its
+// transfer_buffer() so Perl strings sharing them are emptied.
+static V8Worker::Message*
+serialize_message(
+    Isolate* isolate,
+    Local<Context> ctx,
+    Local<Value> value,
+    const vector<Local<ArrayBuffer> >& transfer,
+    V8Context* host
+) {
+    for (size_t i = 0; i < transfer.size(); i++) {
+        if (!transfer[i]->IsNeuterable()) {
+            isolate->ThrowException(Exception::TypeError(
+                String::NewFromUtf8(isolate, "ArrayBuffer cannot be transferred")));
+            return NULL;
+        }
+    }
+
+    CloneDelegate delegate(isolate);
+    ValueSerializer serializer(isolate, &delegate);
+    for (size_t i = 0; i < transfer.size(); i++)
+        serializer.TransferArrayBuffer(i, transfer[i]);
+
+    serializer.WriteHeader();
+    if (!serializer.WriteValue(ctx, value).FromMaybe(false))
+        return NULL;
+
+    V8Worker::Message* message = new V8Worker::Message();
+    for (size_t i = 0; i < transfer.size(); i++) {
+        V8Worker::Buffer buffer;
+        if (host
+                ? host->transfer_buffer(transfer[i], buffer.data, buffer.length)
+                : take_buffer(transfer[i], buffer.data, buffer.length))
+            message->buffers.push_back(buffer);
+    }
+
+    pair<uint8_t*, size_t> out = serializer.Release();
+    message->data = out.first;
+    message->size = out.second;
+    return message;
+}
+
+// Transferred contents are handed to the receiving isolate, which frees
+// them with the rest of its buffers.
+static MaybeLocal<Value>
+deserialize_message(Isolate* isolate, Local<Context> ctx, V8Worker::Message* message) {
+    ValueDeserializer deserializer(isolate, message->data, message->size);
+    for (size_t i = 0; i < message->buffers.size(); i++) {
+        V8Worker::Buffer& buffer = message->buffers[i];
+        deserializer.TransferArrayBuffer(i, ArrayBuffer::New(
+            isolate, buffer.data, buffer.length, ArrayBufferCreationMode::kInternalized));
+    }
+    message->buffers.clear();
+
+    if (!deserializer.ReadHeader(ctx).FromMaybe(false))
+        return MaybeLocal<Value>();
+    return deserializer.ReadValue(ctx);
+}
+
+static V8Worker::Message*
+error_message(const TryCatch& try_catch) {
+    V8Worker::Message* message = new V8Worker::Message();
+    message->error = format_error(try_catch.Exception(), try_catch.Message());
+    return message;
+}
+
+static void
+worker_post_message(const FunctionCallbackInfo<Value>& args) {
+    V8Worker* worker = static_cast<V8Worker*>(Local<External>::Cast(args.Data())->Value());
+    Isolate* isolate = args.GetIsolate();
+    Local<Context> ctx = isolate->GetCurrentContext();
+
+    vector<Local<ArrayBuffer> > transfer;
+    if (args.Length() > 1 && !args[1]->IsUndefined()) {
+        if (!args[1]->IsArray()) {
+            isolate->ThrowException(Exception::TypeError(
+                String::NewFromUtf8(isolate, "postMessage: transfer list must be an array")));
+            return;
+        }
+
+        Local<Array> list = Local<Array>::Cast(args[1]);
+        for (uint32_t i = 0; i < list->Length(); i++) {
+            Local<Value> item;
+            if (!list->Get(ctx, i).ToLocal(&item))
+                return;
+            if (!item->IsArrayBuffer()) {
+                isolate->ThrowException(Exception::TypeError(
+                    String::NewFromUtf8(isolate, "postMessage: only ArrayBuffers can be transferred")));
+                return;
+            }
+            transfer.push_back(Local<ArrayBuffer>::Cast(item));
+        }
+    }
+
+    Local<Value> value = args.Length() ? args[0] : Local<Value>::Cast(Undefined(isolate));
+    V8Worker::Message* message = serialize_message(isolate, ctx, value, transfer, NULL);
+    if (message)
+        worker->post(message);
+}
+
+static void
+worker_close(const FunctionCallbackInfo<Value>& args) {
+    static_cast<V8Worker*>(Local<External>::Cast(args.Data())->Value())->close();
+}
+
+V8Worker::V8Worker(SV* source_, SV* origin_)
+    : host(new V8Context(0, "", false, "")),
+      joined(true),
+      isolate(NULL),
+      stopping(false),
+      finished(false)
+{
+    STRLEN len;
+    const char* pv = SvPVutf8(source_, len);
+    source.assign(pv, len);
+
+    if (origin_ && SvOK(origin_)) {
+        pv = SvPVutf8(origin_, len);
+        origin.assign(pv, len);
+    }
+    else {
+        origin = "worker";
+    }
+
+    // The worker blocks reading its inbox; the outbox is polled by Perl.
+    inbox_fds[0] = inbox_fds[1] = outbox_fds[0] = outbox_fds[1] = -1;
+    if (pipe(inbox_fds) != 0 || pipe(outbox_fds) != 0) {
+        finished = true;
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(inbox_fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(outbox_fds[i], F_SETFL, fcntl(outbox_fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(outbox_fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    fcntl(inbox_fds[1], F_SETFL, fcntl(inbox_fds[1], F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_init(&lock, NULL);
+    if (pthread_create(&thread, NULL, start, this) == 0)
+        joined = false;
+    else
+        finished = true;
+}
+
+V8Worker::~V8Worker() {
+    terminate();
+
+    Message* message;
+    while (inbox.pop(message))
+        delete message;
+    while (outbox.pop(message))
+        delete message;
+
+    for (int i = 0; i < 2; i++) {
+        if (inbox_fds[i] >= 0)
+            ::close(inbox_fds[i]);
+        if (outbox_fds[i] >= 0)
+            ::close(outbox_fds[i]);
+    }
+
+    if (inbox_fds[0] >= 0 && outbox_fds[0] >= 0)
+        pthread_mutex_destroy(&lock);
+    delete host;
+}
+
+void*
+V8Worker::start(void* self) {
+    static_cast<V8Worker*>(self)->run();
+    return NULL;
+}
+
+// Runs on the worker's thread, so nothing here may touch Perl.
+void
+V8Worker::run() {
+    ArrayBuffer::Allocator* allocator = new TerminatedAllocator();
+    Isolate::CreateParams params;
+    params.array_buffer_allocator = allocator;
+    Isolate* worker_isolate = Isolate::New(params);
+
+    pthread_mutex_lock(&lock);
+    isolate = worker_isolate;
+    pthread_mutex_unlock(&lock);
+
+    {
+        Isolate::Scope isolate_scope(worker_isolate);
+        HandleScope handle_scope(worker_isolate);
+        Local<Context> ctx = Context::New(worker_isolate);
+        Context::Scope context_scope(ctx);
+        TryCatch try_catch(worker_isolate);
+
+        Local<Object> global = ctx->Global();
+        Local<External> self = External::New(worker_isolate, this);
+        global->Set(ctx, String::NewFromUtf8(worker_isolate, "self"), global).IsJust();
+        global->Set(
+            ctx,
+            String::NewFromUtf8(worker_isolate, "postMessage"),
+            Function::New(ctx, worker_post_message, self).ToLocalChecked()
+        ).IsJust();
+        global->Set(
+            ctx,
+            String::NewFromUtf8(worker_isolate, "close"),
+            Function::New(ctx, worker_close, self).ToLocalChecked()
+        ).IsJust();
+
+        Local<String> code = String::NewFromUtf8(
+            worker_isolate, source.data(), NewStringType::kNormal, source.size()).ToLocalChecked();
+        ScriptOrigin script_origin(String::NewFromUtf8(
+            worker_isolate, origin.data(), NewStringType::kNormal, origin.size()).ToLocalChecked());
+
+        Local<Script> script;
+        if (!stopping
+                && (!Script::Compile(ctx, code, &script_origin).ToLocal(&script)
+                    || script->Run(ctx).IsEmpty())) {
+            if (!try_catch.HasTerminated())
+                post(error_message(try_catch));
+            stopping = true;
+        }
+
+        while (!stopping) {
+            Message* message;
+            while (!stopping && inbox.pop(message)) {
+                deliver(ctx, message);
+                delete message;
+            }
+
+            while (!stopping && platform::PumpMessageLoop(v8_platform, worker_isolate))
+                ;
+
+            // A byte is written after every push, so this can't miss one.
+            char buf[64];
+            if (!stopping && inbox.empty() && read(inbox_fds[0], buf, sizeof(buf)) < 0 && errno != EINTR)
+                break;
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+    isolate = NULL;
+    pthread_mutex_unlock(&lock);
+
+    worker_isolate->Dispose();
+    delete allocator;
+
+    finished = true;
+    poke(outbox_fds[1]);
+}
+
+void
+V8Worker::deliver(Local<Context> ctx, Message* message) {
+    Isolate* worker_isolate = ctx->GetIsolate();
+    HandleScope handle_scope(worker_isolate);
+    TryCatch try_catch(worker_isolate);
+
+    Local<Value> data, handler;
+    if (!deserialize_message(worker_isolate, ctx, message).ToLocal(&data)
+            || !ctx->Global()->Get(ctx, String::NewFromUtf8(worker_isolate, "onmessage")).ToLocal(&handler)) {
+        if (!try_catch.HasTerminated())
+            post(error_message(try_catch));
+        return;
+    }
+    if (!handler->IsFunction())
+        return;
+
+    Local<Object> event = Object::New(worker_isolate);
+    event->Set(ctx, String::NewFromUtf8(worker_isolate, "data"), data).IsJust();
+
+    Local<Value> argv[] = { event };
+    if (Local<Function>::Cast(handler)->Call(ctx, ctx->Global(), 1, argv).IsEmpty()
+            && !try_catch.HasTerminated())
+        post(error_message(try_catch));
+}
+
+void
+V8Worker::post(Message* message) {
+    outbox.push(message);
+    poke(outbox_fds[1]);
+}
+
+void
+V8Worker::close() {
+    stopping = true;
+}
+
+// Messages to a worker which has finished are dropped.
+void
+V8Worker::post_message(SV* data, SV* transfer) {
+    if (transfer && SvOK(transfer) && !(SvROK(transfer) && SvTYPE(SvRV(transfer)) == SVt_PVAV))
+        croak("post_message: transfer list must be an array reference");
+
+    string error;
+    {
+        Isolate* host_isolate = host->isolate;
+        Isolate::Scope isolate_scope(host_isolate);
+        HandleScope handle_scope(host_isolate);
+        Local<Context> ctx = host->get_local_context();
+        Context::Scope context_scope(ctx);
+        TryCatch try_catch(host_isolate);
+
+        vector<Local<ArrayBuffer> > buffers;
+        if (transfer && SvOK(transfer)) {
+            AV* av = (AV*)SvRV(transfer);
+            for (SSize_t i = 0; i <= av_len(av); i++) {
+                SV** item = av_fetch(av, i, 0);
+                Local<Value> value = item ? host->sv2v8(*item) : Local<Value>();
+                if (!value.IsEmpty() && value->IsArrayBuffer())
+                    buffers.push_back(Local<ArrayBuffer>::Cast(value));
+                else if (!value.IsEmpty() && value->IsArrayBufferView())
+                    buffers.push_back(Local<ArrayBufferView>::Cast(value)->Buffer());
+                else {
+                    error = "post_message: only buffers returned by JavaScript can be transferred\n";
+                    break;
+                }
+            }
+        }
+
+        if (error.empty()) {
+            Message* message = serialize_message(host_isolate, ctx, host->sv2v8(data), buffers, host);
+            if (message) {
+                inbox.push(message);
+                poke(inbox_fds[1]);
+            }
+            else {
+                error = format_error(try_catch.Exception(), try_catch.Message());
+            }
+        }
+    }
+
+    if (!error.empty())
+        croak("%s", error.c_str());
+}
+
+// Returns undef, with $@ set if the worker reported an error, when there is
+// nothing to return.
+SV*
+V8Worker::get_message() {
+    Message* message;
+    bool got = outbox.pop(message);
+
+    // One byte may stand for several messages, so the pipe stays readable
+    // while any are left.
+    char buf[64];
+    while (read(outbox_fds[0], buf, sizeof(buf)) > 0)
+        ;
+    if (!outbox.empty())
+        poke(outbox_fds[1]);
+
+    sv_setsv(ERRSV, &PL_sv_undef);
+    if (!got)
+        return &PL_sv_undef;
+
+    if (!message->error.empty()) {
+        sv_setpv(ERRSV, message->error.c_str());
+        sv_utf8_upgrade(ERRSV);
+        delete message;
+        return &PL_sv_undef;
+    }
+
+    SV* result = NULL;
+    {
+        Isolate* host_isolate = host->isolate;
+        Isolate::Scope isolate_scope(host_isolate);
+        HandleScope handle_scope(host_isolate);
+        Local<Context> ctx = host->get_local_context();
+        Context::Scope context_scope(ctx);
+        TryCatch try_catch(host_isolate);
+
+        Local<Value> value;
+        if (deserialize_message(host_isolate, ctx, message).ToLocal(&value))
+            result = host->v82sv(value);
+        else
+            set_perl_error(try_catch);
+    }
+
+    delete message;
+    return result ? result : &PL_sv_undef;
+}
+
+int
+V8Worker::fd() {
+    return outbox_fds[0];
+}
+
+bool
+V8Worker::running() {
+    return !finished;
+}
+
+// Stops the script even in the middle of a long computation, and waits for
+// the thread to finish.
+void
+V8Worker::terminate() {
+    if (inbox_fds[0] < 0 || outbox_fds[0] < 0)
+        return;
+
+    stopping = true;
+    pthread_mutex_lock(&lock);
+    if (isolate)
+        isolate->TerminateExecution();
+    pthread_mutex_unlock(&lock);
+    poke(inbox_fds[1]);
+
+    if (!joined) {
+        pthread_join(thread, NULL);
+        joined = true;
+    }
 }
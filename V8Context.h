@@ -6,7 +6,11 @@
 
 #include <vector>
 #include <map>
+#include <set>
 #include <string>
+#include <atomic>
+
+#include <pthread.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,38 +28,186 @@ extern "C" {
 using namespace v8;
 using namespace std;
 
+#define V8_VERSION_AT_LEAST(major, minor) \
+    (V8_MAJOR_VERSION > (major) || (V8_MAJOR_VERSION == (major) && V8_MINOR_VERSION >= (minor)))
+
 typedef map<string, Persistent<Object, CopyablePersistentTraits<Object>> > ObjectMap;
 
-class SimpleObjectData {
-public:
-    Handle<Object> object;
-    long ptr;
+// An object template with one property per key of a hash, in sorted order,
+// so that all hashes with these keys convert to objects of the same shape.
+struct ObjectShape {
+    Persistent<ObjectTemplate, CopyablePersistentTraits<ObjectTemplate>> tmpl;
+    vector<Persistent<String, CopyablePersistentTraits<String>> > keys;
+};
+
+typedef map<string, ObjectShape> ShapeMap;
+
+// Open-addressing hash table used while converting a data structure, to
+// find what a reference or object has already been converted to. Entries
+// are never removed and live in one flat array--the first few inline, so
+// converting a small structure allocates nothing. A disabled map (for data
+// declared acyclic) stores and finds nothing.
+template <class Key, class Value>
+class IdentityMap {
+    struct Entry {
+        Key key;
+        Value value;
+        unsigned hash;
+        bool used;
+
+        Entry() : hash(0), used(false) { }
+    };
+
+    enum { INLINE_ENTRIES = 16 };
+
+    Entry inline_entries[INLINE_ENTRIES];
+    Entry* entries;
+    size_t mask;
+    size_t count;
+    bool enabled_;
+
+    void insert(unsigned hash, const Key& key, const Value& value) {
+        size_t i = hash & mask;
+        while (entries[i].used)
+            i = (i + 1) & mask;
+
+        entries[i].key = key;
+        entries[i].value = value;
+        entries[i].hash = hash;
+        entries[i].used = true;
+        count++;
+    }
+
+    void grow() {
+        Entry* old = entries;
+        size_t size = mask + 1;
+
+        entries = new Entry[size * 2];
+        mask = size * 2 - 1;
+        count = 0;
+        for (size_t i = 0; i < size; i++) {
+            if (old[i].used)
+                insert(old[i].hash, old[i].key, old[i].value);
+        }
 
-    SimpleObjectData(Handle<Object> object_, long ptr_)
-        : object(object_)
-        , ptr(ptr_)
+        if (old != inline_entries)
+            delete[] old;
+    }
+
+public:
+    IdentityMap(bool enabled = true)
+        : entries(inline_entries)
+        , mask(INLINE_ENTRIES - 1)
+        , count(0)
+        , enabled_(enabled)
     { }
+
+    ~IdentityMap() {
+        if (entries != inline_entries)
+            delete[] entries;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    void add(unsigned hash, const Key& key, const Value& value) {
+        if (!enabled_)
+            return;
+        if ((count + 1) * 2 > mask + 1)
+            grow();
+        insert(hash, key, value);
+    }
+
+    bool find(unsigned hash, const Key& key, Value& value) const {
+        for (size_t i = hash & mask; entries[i].used; i = (i + 1) & mask) {
+            if (entries[i].hash == hash && entries[i].key == key) {
+                value = entries[i].value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    IdentityMap(const IdentityMap&);
+    IdentityMap& operator=(const IdentityMap&);
 };
 
+// JavaScript objects converted to Perl, by identity hash. Handles compare
+// by identity, so no Equals() calls. Also keeps the shared hash keys made
+// for property names, which V8 internalizes, so a key repeated across many
+// records is converted and hashed once per conversion.
 class SvMap {
-    typedef multimap<int, SimpleObjectData*> sv_map;
-    sv_map objects;
+    IdentityMap<Handle<Object>, SV*> objects;
+    IdentityMap<Handle<String>, SV*> keys;
+    vector<SV*> key_svs;
 
 public:
-    SvMap () { }
+    SvMap(bool enabled = true) : objects(enabled) { }
 
     ~SvMap() {
-        for (sv_map::iterator it = objects.begin(); it != objects.end(); it++)
-            delete it->second;
+        for (size_t i = 0; i < key_svs.size(); i++)
+            SvREFCNT_dec(key_svs[i]);
     }
 
-    void add(Handle<Object> object, long ptr);
-    SV* find(Handle<Object> object);
+    void add_key(Handle<String> name, SV* key) {
+        keys.add(name->GetIdentityHash(), name, key);
+        key_svs.push_back(key);
+    }
+
+    SV* find_key(Handle<String> name) {
+        SV* key;
+        if (keys.find(name->GetIdentityHash(), name, key))
+            return key;
+        return NULL;
+    }
+
+    void add(Handle<Object> object, SV* sv) {
+        if (objects.enabled())
+            objects.add(object->GetIdentityHash(), object, sv);
+    }
+
+    SV* find(Handle<Object> object) {
+        SV* sv;
+        if (objects.enabled() && objects.find(object->GetIdentityHash(), object, sv))
+            return newRV_inc(sv);
+        return NULL;
+    }
 };
 
-typedef map<int, Handle<Value> > HandleMap;
+inline unsigned ptr_hash(IV ptr) {
+    UV h = (UV)ptr >> 3; // SV heads are 8-byte aligned on 64-bit perls
+#if UVSIZE > 4
+    h ^= h >> 32;
+#endif
+    return (unsigned)h * 2654435761U;
+}
+
+// Perl values converted to JavaScript, by full-width address.
+class HandleMap {
+    IdentityMap<IV, Handle<Value> > values;
+
+    static unsigned hash(IV ptr) {
+        return ptr_hash(ptr);
+    }
+
+public:
+    HandleMap(bool enabled = true) : values(enabled) { }
+
+    void add(IV ptr, Handle<Value> value) {
+        values.add(hash(ptr), ptr, value);
+    }
+
+    // An empty handle if not seen
+    Handle<Value> find(IV ptr) const {
+        Handle<Value> value;
+        values.find(hash(ptr), ptr, value);
+        return value;
+    }
+};
 
 class V8Context;
+class IsolateGroup;
+class TimerQueue;
 
 class ObjectData {
 public:
@@ -78,47 +230,163 @@ public:
 };
 
 class PerlObjectData : public ObjectData {
-    size_t bytes;
+    Isolate* isolate;
+    int64_t bytes;
 
 public:
     PerlObjectData(V8Context* context_, Handle<Object> object_, SV* sv_);
     virtual ~PerlObjectData();
 
     virtual size_t size();
-    void add_size(size_t bytes_);
+    void add_size(int64_t bytes_);
 
     static void destroy(const WeakCallbackInfo<PerlObjectData>&);
 };
 
 typedef map<int, ObjectData*> ObjectDataMap;
 
+// Unbounded queue for one producer thread and one consumer thread. The
+// producer only touches tail, the consumer only head, and the two meet at
+// a node's next pointer.
+template <class T>
+class SpscQueue {
+    struct Node {
+        T value;
+        std::atomic<Node*> next;
+
+        Node() : next(NULL) { }
+    };
+
+    Node* head; // last node taken, or the initial dummy
+    Node* tail;
+
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator=(const SpscQueue&);
+
+public:
+    SpscQueue() : head(new Node()), tail(head) { }
+
+    ~SpscQueue() {
+        while (head) {
+            Node* next = head->next.load();
+            delete head;
+            head = next;
+        }
+    }
+
+    // Producer side
+    void push(const T& value) {
+        Node* node = new Node();
+        node->value = value;
+        tail->next.store(node, std::memory_order_release);
+        tail = node;
+    }
+
+    // Consumer side
+    bool pop(T& value) {
+        Node* next = head->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = next->value;
+        delete head;
+        head = next;
+        return true;
+    }
+
+    bool empty() const {
+        return !head->next.load(std::memory_order_acquire);
+    }
+};
+
+struct JsonWalk;
+
+class V8Script {
+public:
+    V8Script(V8Context* context_, Handle<Script> script_);
+    ~V8Script();
+
+    SV* run();
+
+    V8Context* context;
+    Persistent<Script, CopyablePersistentTraits<Script>> script;
+};
+
 class V8Context {
     public:
         V8Context(
             int time_limit = 0,
             const char* flags = NULL,
             bool enable_blessing = false,
-            const char* bless_prefix = NULL
+            const char* bless_prefix = NULL,
+            const char* code_cache_dir = NULL,
+            const char* snapshot = NULL,
+            const char* isolate_group = NULL,
+            bool own_isolate = false,
+            int max_heap_mb = 0,
+            int initial_heap_mb = 0,
+            bool stable_shapes = false,
+            bool lazy_results = false,
+            bool typed_arrays = false,
+            bool acyclic = false,
+            int bulk_threshold = 0,
+            bool explicit_microtasks = false,
+            bool timers = false,
+            int platform_threads = 0,
+            bool futures = false
         );
         ~V8Context();
 
         void bind(const char*, SV*);
         void bind_ro(const char*, SV*);
+        void bind_view(const char*, SV*);
+        void bind_buffer(const char*, SV*);
         SV* eval(SV* source, SV* origin = NULL);
+        SV* eval_async(SV* source, SV* origin = NULL);
+        void run_microtasks();
+        int pending_fd();
+        SV* next_deadline();
+        SV* run_pending(int max = 0);
+        bool transfer_buffer(Handle<ArrayBuffer> buffer, void*& data, size_t& length);
+        int pump_message_loop();
+        void run_idle_tasks(double seconds);
+        SV* compile(SV* source, SV* origin = NULL);
+        SV* compile_function(SV* params, SV* body, SV* origin = NULL);
         bool idle_notification();
-        int adjust_amount_of_external_allocated_memory(int bytes);
+        SV* heap_statistics();
+        SV* heap_space_statistics();
+        IV adjust_amount_of_external_allocated_memory(IV bytes);
         void set_flags_from_string(char *str);
         void name_global(const char *str);
+        SV* code_cache_stats();
+        SV* conversion_stats();
+        void reset();
+        int eval_count();
+        int total_eval_count();
+
+        static SV* create_snapshot(const char* file, SV* sources);
 
         Handle<Value> sv2v8(SV*);
         SV*           v82sv(Handle<Value>);
+        Handle<Value> sv2view(SV*);
+        SV*           materialize(Handle<Object>);
 
+        Isolate* isolate;
         Persistent<Context, CopyablePersistentTraits<Context>> context;
 
         void register_object(ObjectData* data);
         void remove_object(ObjectData* data);
 
-        Persistent<Function> make_function;
+        void register_script(V8Script* script);
+        void remove_script(V8Script* script);
+
+        SV* run_script(Handle<Script> script, TryCatch& try_catch, bool async = false);
+        Handle<Value> settle(Handle<Promise> promise, TryCatch& try_catch);
+        int run_timers(Local<Context> ctx, TryCatch& try_catch, int max);
+        MicrotasksScope::Type microtasks_scope() const {
+            return explicit_microtasks ? MicrotasksScope::kDoNotRunMicrotasks : MicrotasksScope::kRunMicrotasks;
+        }
+        void queued_microtasks();
+        void set_call_error(const TryCatch& try_catch);
 
         Local<Context> get_local_context();
 
@@ -126,19 +394,34 @@ class V8Context {
 
     private:
         Handle<Value>    sv2v8(SV*, HandleMap& seen);
+        Handle<Value>    sv2v8_bulk(SV*);
+        bool             json_encode(SV*, string& out, IdentityMap<IV, bool>& seen, size_t& values, int depth);
         SV*              v82sv(Handle<Value>, SvMap& seen);
+        SV*              v82sv_bulk(Handle<Value>);
+        bool             json_plain(Handle<Value>, JsonWalk& walk, int depth);
 
         Handle<Value>    rv2v8(SV*, HandleMap& seen);
-        Handle<Array>    av2array(AV*, HandleMap& seen, long ptr);
+        Handle<Object>   av2array(AV*, HandleMap& seen, long ptr);
+        Handle<Object>   av2typed(AV*, I32 len);
         Handle<Object>   hv2object(HV*, HandleMap& seen, long ptr);
+        Handle<Object>   hv2shaped(HV*, HandleMap& seen, long ptr);
         Handle<Object>   cv2function(CV*);
         Handle<String>   sv2v8str(SV* sv);
+        SV*              str2sv(Handle<String> str);
+        Handle<Script>   compile_script(SV* source, SV* origin);
+        Handle<Script>   compile_cached(Handle<String> source, Handle<String> origin, const string& path);
+        string           code_cache_path(SV* source, SV* origin);
         Handle<Object>   blessed2object(SV *sv);
 
         SV* array2sv(Handle<Array>, SvMap& seen);
         SV* object2sv(Handle<Object>, SvMap& seen);
         SV* object2blessed(Handle<Object>);
+        SV* object2proxy(Handle<Object>, bool array);
+        SV* buffer2sv(Handle<Object>);
+        SV* typed2sv(Handle<TypedArray>);
         SV* function2sv(Handle<Function>);
+        SV* promise2future(Handle<Promise>);
+        Handle<Value> thenable2promise(SV*);
 
         Persistent<String> string_wrap;
 
@@ -147,13 +430,106 @@ class V8Context {
 
         ObjectMap prototypes;
 
+        ShapeMap shapes;
+        void clear_shapes();
+
+        Persistent<ObjectTemplate> hash_view;
+        Persistent<ObjectTemplate> array_view;
+        Handle<ObjectTemplate> view_template(bool array);
+
+        void detach_objects(bool disposing);
+        void start_timers(Local<Context> ctx);
+        void clear_timers();
+        void stop_timers();
+
         ObjectDataMap seen_perl;
+        set<V8Script*> scripts;
         SV* seen_v8(Handle<Object> object);
 
+        IsolateGroup* group;
+
         int time_limit_;
         string bless_prefix;
+        string code_cache_dir;
+        int code_cache_hits;
+        int code_cache_misses;
+        int code_cache_rejects;
+        int evals;
+        int total_evals;
         bool enable_blessing;
+        bool stable_shapes;
+        bool lazy_results;
+        bool typed_arrays;
+        bool acyclic;
+        int bulk_threshold;
+        bool explicit_microtasks;
+        bool install_timers;
+        bool futures;
+        bool microtasks_pending;
+        TimerQueue* timers;
+        int bulk_to_js;
+        int bulk_to_perl;
+        int direct_to_js;
+        int direct_to_perl;
+        int bulk_bailouts;
+        bool materializing;
         static int number;
 };
 
+// A script running in an isolate of its own on a native thread. Messages
+// in either direction are ValueSerializer output plus the contents of any
+// ArrayBuffers transferred with them; the Perl side's values are converted
+// by a private context.
+class V8Worker {
+public:
+    V8Worker(SV* source, SV* origin);
+    ~V8Worker();
+
+    void post_message(SV* data, SV* transfer = NULL);
+    SV* get_message();
+    int fd();
+    bool running();
+    void terminate();
+
+    struct Buffer {
+        void* data;
+        size_t length;
+    };
+
+    struct Message {
+        uint8_t* data;
+        size_t size;
+        vector<Buffer> buffers;
+        string error;
+
+        Message() : data(NULL), size(0) { }
+        ~Message();
+    };
+
+    // Worker thread side
+    void post(Message* message);
+    void close();
+
+private:
+    V8Context* host;
+    string source;
+    string origin;
+
+    SpscQueue<Message*> inbox;
+    SpscQueue<Message*> outbox;
+    int inbox_fds[2];
+    int outbox_fds[2];
+
+    pthread_t thread;
+    bool joined;
+    pthread_mutex_t lock;
+    Isolate* isolate;       // the worker's, while it exists
+    std::atomic<bool> stopping;
+    std::atomic<bool> finished;
+
+    static void* start(void* self);
+    void run();
+    void deliver(Local<Context> ctx, Message* message);
+};
+
 #endif
@@ -113,6 +113,14 @@ Similar packages may be available for other distributions (adjust the package na
 Details on the context object and the mapping between JavaScript and Perl
 types.
 
+=item * L<JavaScript::V8::ContextPool>
+
+A pool of contexts which are reset between uses.
+
+=item * L<JavaScript::V8::Worker>
+
+Scripts running on background threads, talking to Perl through messages.
+
 =back
 
 =head2 Extension modules
@@ -6,15 +6,63 @@ use warnings;
 sub new {
     my($class, %args) = @_;
 
-    my $time_limit = delete $args{time_limit} || 0;
+    # The watchdog works in milliseconds
+    my $time_limit = int((delete $args{time_limit} || 0) * 1000 + 0.5);
     my $flags = delete $args{flags} || '';
     my $enable_blessing
         = exists $args{enable_blessing}
         ? delete $args{enable_blessing}
         : (exists $args{bless_prefix} ? 1 : 0);
     my $bless_prefix = delete $args{bless_prefix} || '';
+    my $code_cache = delete $args{code_cache} || '';
+    my $snapshot = delete $args{snapshot} || '';
+    my $isolate_group = delete $args{isolate_group};
+    my $own_isolate = delete $args{own_isolate} ? 1 : 0;
+    my $max_heap_mb = delete $args{max_heap_mb} || 0;
+    my $initial_heap_mb = delete $args{initial_heap_mb} || 0;
+    my $stable_shapes = delete $args{stable_shapes} ? 1 : 0;
+    my $lazy_results = delete $args{lazy_results} ? 1 : 0;
+    my $typed_arrays = delete $args{typed_arrays} ? 1 : 0;
+    my $acyclic = delete $args{acyclic} ? 1 : 0;
+    my $bulk_threshold = delete $args{bulk_threshold} || 0;
+    my $microtasks = delete $args{microtasks} || 'auto';
+    my $timers = delete $args{timers} ? 1 : 0;
+    my $platform_threads = delete $args{platform_threads} || 0;
+    my $futures = delete $args{futures} ? 1 : 0;
+
+    die "microtasks must be auto or explicit\n"
+        unless $microtasks eq 'auto' || $microtasks eq 'explicit';
+
+    # Heap limits can't be applied to the shared default isolate, and
+    # contexts sharing one share its microtask queue too
+    die "microtasks => 'explicit' needs an isolate of its own, not isolate_group\n"
+        if $microtasks eq 'explicit' && defined $isolate_group && !$own_isolate;
+    $own_isolate = 1
+        if ($max_heap_mb || $initial_heap_mb || $microtasks eq 'explicit') && !defined $isolate_group;
+    $isolate_group = '' unless defined $isolate_group;
+
+    if (length $code_cache && !-d $code_cache) {
+        mkdir $code_cache
+            or die "Unable to create code cache directory $code_cache: $!\n";
+    }
+
+    $class->_new(
+        $time_limit, $flags, $enable_blessing, $bless_prefix, $code_cache,
+        $snapshot, $isolate_group, $own_isolate, $max_heap_mb, $initial_heap_mb,
+        $stable_shapes, $lazy_results, $typed_arrays, $acyclic, $bulk_threshold,
+        $microtasks eq 'explicit' ? 1 : 0, $timers, $platform_threads,
+        $futures,
+    );
+}
+
+sub create_snapshot {
+    my($class, %args) = @_;
+
+    my $file = delete $args{file}
+        or die "create_snapshot needs a file\n";
+    my $scripts = delete $args{scripts} || [];
 
-    $class->_new($time_limit, $flags, $enable_blessing, $bless_prefix);
+    $class->_create_snapshot($file, $scripts);
 }
 
 sub bind_function {
@@ -22,6 +70,16 @@ sub bind_function {
     $class->bind(@_);
 }
 
+# Tie classes for lazy_results. FETCH, STORE and friends are XS; these
+# supply the rest of the interface on top of them.
+package JavaScript::V8::Object;
+require Tie::Hash;
+our @ISA = ('Tie::Hash');
+
+package JavaScript::V8::Array;
+require Tie::Array;
+our @ISA = ('Tie::Array');
+
 1;
 
 =encoding utf8
@@ -67,6 +125,11 @@ Several optional parameters are accepted:
 
 Force an exception after the script has run for a number of seconds; this
 limit will be enforced even if V8 calls back to Perl or blocks on IO.
+Fractional values are accepted, down to a resolution of one millisecond.
+
+All contexts in a process share a single watchdog thread, so a time limit
+adds almost nothing to the cost of C<eval()>. When the limit is reached
+C<eval()> returns undef and C<$@> says the execution was terminated.
 
 =item enable_blessing
 
@@ -87,8 +150,184 @@ no effect unless C<enable_blessing> is set.
 Specify a string of flags to be passed to V8. See
 C<set_flags_from_string()> for more details.
 
+=item code_cache
+
+A directory in which compiled code is cached between processes. Sources
+passed to C<eval()> and C<compile()> are looked up by a hash of the
+source, its origin and the V8 version; the first compile writes the cache
+and later ones, in this or any other process, consume it instead of
+compiling from scratch. The directory is created if it does not exist.
+
+Caches that V8 refuses (for example, because they were produced with
+different flags) are replaced. See C<code_cache_stats()>.
+
+=item snapshot
+
+A file written by C<create_snapshot()>. New contexts start out as a copy of
+the context the snapshot was taken from, so libraries it loaded do not
+have to be evaluated again.
+
+V8 can only restore a snapshot into a new isolate, so all contexts in an
+isolate group must be created with the same snapshot (or none); otherwise
+C<new> dies. Use C<own_isolate> or C<isolate_group> to mix snapshots in
+one process.
+
+=item own_isolate
+
+By default all contexts in a process share one V8 isolate, and so one
+heap, one garbage collector and one time limit watchdog target. If true,
+this context gets an isolate of its own, which is disposed of along with
+the context. Values can't be passed directly between contexts in
+different isolates; convert them to Perl data first.
+
+=item isolate_group
+
+Contexts created with the same group name share an isolate, separate from
+the default one. The isolate is disposed of when the last context in the
+group is destroyed.
+
+=item max_heap_mb
+
+Limits the size of the isolate's old generation heap, in megabytes. A
+script which runs out of heap is terminated: C<eval()> returns undef and
+sets C<$@> to C<JavaScript heap limit exceeded>, and the context remains
+usable. Without a limit, V8 aborts the whole process when the heap is
+exhausted. This needs V8 6.5 or later; with older versions C<new> dies.
+
+After a script runs out of heap the limit is raised while what it left
+behind may still be reachable, and goes back down once later scripts have
+let enough of it go.
+
+=item initial_heap_mb
+
+The initial size of the isolate's old generation heap, in megabytes.
+Starting larger avoids garbage collections while a heap grows.
+
+Heap sizes are properties of an isolate, so either option gives the
+context its own isolate unless C<isolate_group> is given, in which case
+the sizes of the first context in the group apply.
+
+=item stable_shapes
+
+Converts hashes with their keys in sorted order, rather than Perl's
+randomized hash order. Records with the same keys then share one hidden
+class in V8, which keeps property access in hot JavaScript loops fast,
+and JavaScript sees the same key order from run to run. Hashes with more
+than 64 keys are converted as usual.
+
+=item typed_arrays
+
+Converts arrays holding nothing but numbers to an C<Int32Array> when all
+of them are integers which fit, or to a C<Float64Array> otherwise. These
+are much faster to create and to work with for large numeric arrays, but
+unlike ordinary arrays they cannot grow and coerce whatever is assigned to
+them to a number. A single string, reference or undef keeps an array an
+ordinary C<Array>.
+
+Whether or not this is set, typed arrays other than C<Uint8Array> (see
+L</bind_buffer>) come back to Perl as array references.
+
+=item acyclic
+
+Promises that no data passed between Perl and JavaScript refers back to
+itself, so conversions need not keep track of what they have already
+converted. This makes converting large structures faster. A structure
+which is reached twice is converted twice, into two separate copies, and a
+structure which does contain a cycle recurses until the process runs out
+of stack.
+
+=item bulk_threshold
+
+Converts data structures with at least this many values in them through
+JSON, which V8 parses and prints much faster than values can be created or
+read one at a time. 0 (the default) never does.
+
+Perl data is only sent this way when it converts exactly the same either
+way: plain arrays and hashes of strings and numbers. Anything with undef,
+code refs, objects, tied or bound data, or a structure which is referenced
+twice is converted the usual way.
+
+Likewise, JavaScript results only go through JSON when they contain
+nothing but plain objects and arrays of strings, finite numbers, booleans
+and nulls. Anything with functions, C<undefined> properties, C<NaN> or
+C<Infinity>, getters, C<toJSON> methods, dates, typed arrays, maps or other
+special objects, objects which came from Perl, or an object referenced
+twice is converted the usual way, as is everything with C<lazy_results> or
+C<enable_blessing>. So the result never depends on its size. See
+L</conversion_stats>.
+
+=item lazy_results
+
+Returns JavaScript objects and arrays as tied hashes and arrays instead of
+copying them. Nothing is converted until it is used: fetching a key or
+element, C<exists>, C<keys> and the size of an array all go to the
+JavaScript object at that moment, and nested objects become tied hashes
+and arrays in turn. Returning a large result is then cheap when only a
+few of its values are read. As with copied results, C<keys> lists only
+the object's own properties.
+
+  my $result = $context->eval('({ total: 3, rows: bigArray })');
+  print $result->{total};
+
+Assigning to or deleting from the hash or array changes the JavaScript
+object. For a plain copy, call C<materialize> on the tie object:
+
+  my $copy = tied(%$result)->materialize;
+
+The tied hashes and arrays keep their JavaScript objects alive, and stop
+working (they die with C<Fatal error: V8 context is no more>) once the
+context is destroyed or C<reset()>.
+
+=item microtasks
+
+When promise reactions and other microtasks run. With C<auto> (the
+default) they run whenever a call from Perl into JavaScript returns: after
+C<eval()>, a compiled script's C<run()>, or a call to a JavaScript function
+returned to Perl. With C<explicit> they only run from C<run_microtasks()>
+and C<eval_async()>, so Perl decides when asynchronous code makes progress.
+
+Microtasks are queued per isolate, so C<explicit> gives the context an
+isolate of its own (see L</own_isolate>) and cannot be combined with
+C<isolate_group>.
+
+=item platform_threads
+
+The number of worker threads V8 uses for background work such as
+concurrent compilation and garbage collection. 0 (the default) lets V8
+choose. All contexts in a process share one pool of workers, so only the
+first context created has any say.
+
+=item timers
+
+Gives the global object C<setTimeout>, C<setInterval>, C<clearTimeout> and
+C<clearInterval>. Timer callbacks only run from C<run_pending()>, or while
+C<eval_async()> waits for a promise; see L</EVENT LOOPS>.
+
+=item futures
+
+Returns JavaScript promises to Perl as L<Future> objects instead of plain
+objects, once L<Future> is loaded; see L</Futures and promises>.
+
 =back
 
+=item create_snapshot ( file => $file, scripts => \@sources )
+
+A class method which evaluates each of the JavaScript sources in a fresh
+context, in order, and writes the resulting heap to I<$file> for use with
+the C<snapshot> option to C<new>:
+
+  JavaScript::V8::Context->create_snapshot(
+      file    => 'app.snapshot',
+      scripts => [ $polyfills, $framework ],
+  );
+
+  my $context = JavaScript::V8::Context->new(snapshot => 'app.snapshot');
+
+The scripts run without any Perl bindings, so they must not depend on
+values from C<bind()>; Perl functions bound to a context created from the
+snapshot work as usual. Returns true on success, or undef with C<$@> set
+if a script fails or the file can't be written.
+
 =item bind ( name => $scalar )
 
 Converts the given scalar value (array ref, code ref, or hash ref) to a V8
@@ -132,6 +371,28 @@ example:
 
 B<This requires Perl 5.10 or later.>
 
+=item Futures and promises
+
+A L<Future>, or any other object with C<then> and C<catch> methods (such
+as a L<Mojo::Promise>), becomes a JavaScript C<Promise> which settles when
+it does. A future fulfils the promise with its first value. This applies
+wherever Perl values reach JavaScript, so a bound function can start some
+I/O and return a future, and JavaScript can wait for several at once:
+
+  $context->bind(fetch => sub { $http->GET($_[0]) });
+  $context->eval('Promise.all(urls.map(fetch)).then(render)');
+
+With the C<futures> option, and once L<Future> is loaded, JavaScript
+promises come back to Perl as futures which are done or failed when the
+promise settles:
+
+  my $context = JavaScript::V8::Context->new(futures => 1);
+  my $future = $context->eval('renderAsync()');
+  $future->on_done(sub { print $_[0] });
+
+The promise's reactions run as microtasks (see L</microtasks>), so the
+future is only completed after microtasks have run.
+
 =item Arrays
 
 Pass the bind method a JavaScript variable name with an array reference to
@@ -178,6 +439,51 @@ version (the binding may become more complete).
 Like C<bind()> but makes the item read-only on the global object (i.e. it is
 not recursive, if you need that use tie or other Perl mechanisms).
 
+=item bind_view ( $name => $array_or_hash_ref )
+
+Like C<bind()>, but instead of copying the array or hash into JavaScript
+it binds a live view of it. Reading a property reads the Perl data at that
+moment, and assigning to or deleting a property changes the Perl data.
+Nested arrays and hashes become views themselves when they are first
+accessed, so binding a hash with 100,000 entries costs the same as binding
+an empty one.
+
+  my %config = (db => { host => 'localhost' });
+  $context->bind_view(config => \%config);
+  $context->eval('config.db.port = 5432');
+  print $config{db}{port};    # 5432
+
+Array views have a C<length> and the methods of C<Array.prototype>. Values
+assigned from JavaScript are converted as for C<eval()>. Views are worth
+it when JavaScript reads a small part of a large structure; for data that
+is read in full, C<bind()> is faster.
+
+Once an array or hash has a view, binding it again in the same context
+with C<bind()> binds the same view.
+
+=item bind_buffer ( $name => $bytes )
+
+Binds a C<Uint8Array> whose memory is the string buffer of I<$bytes>, so
+binary data such as images can be handed to JavaScript without being
+copied or encoded. Writes from JavaScript show up in I<$bytes>.
+
+While JavaScript can still reach the array, I<$bytes> is read-only, since
+changing it could move its buffer. It becomes writable again once the
+array has been garbage collected. I<$bytes> must be a byte string (see
+L<utf8/utf8::downgrade>); a read-only string is copied first.
+
+In the other direction, C<ArrayBuffer>, C<DataView> and C<Uint8Array>
+values come back from JavaScript as read-only byte strings which share
+their memory with JavaScript. (Views which end before their buffer does
+are copied, because a Perl string has to be followed by a NUL byte.) Assigning such a string to a variable copies
+it, as for any Perl string; to avoid the copy, use it where it is or take
+a reference to it:
+
+  my $png = \ $context->eval('renderPNG()');
+  print {$fh} $$png;
+
+Passing such a string back to JavaScript passes the original object.
+
 =item bind_function ( $name => $subroutine_ref )
 
 DEPRECATED. This is just an alias for bind.
@@ -200,6 +506,9 @@ Perl type:
   Object                      | hash reference or blessed scalar reference
   Array                       | array reference
 
+Objects become hashes of their own enumerable properties; properties
+inherited from a prototype are left out.
+
 If there is a compilation error (such as a syntax error) or an uncaught
 exception is thrown in JavaScript, this method returns undef and $@ is set.
 If an optional origin for C<$source> has been provided, this will be
@@ -212,6 +521,115 @@ created by eval(), so JavaScript exceptions will propagate to Perl code.
 JavaScript function object having a C<__perlReturnsList> property set that
 returns an array will return a list to Perl when called in list context.
 
+=item eval_async ( $source[, $origin] )
+
+Like C<eval()>, but if the result is a promise, runs microtasks until it
+settles and returns the value it is fulfilled with. If it is rejected, or
+nothing left to run could settle it, returns undef and sets C<$@>.
+
+  my $html = $context->eval_async('renderPage(request)');
+
+C<time_limit> applies to the script and the microtasks together.
+
+Only JavaScript can settle the promise while C<eval_async()> waits: it runs
+microtasks and, with C<timers>, sleeps until the next timer, but never
+returns to Perl. A promise waiting on a Perl future (see L</Futures and
+promises>) therefore counts as never settled unless the future is already
+done. Use C<eval()> and complete the future from your event loop instead.
+
+=item run_microtasks ( )
+
+Runs the microtasks which are waiting, and any they queue in turn. This is
+only needed with C<< microtasks => 'explicit' >>.
+
+=item run_pending ( [$max] )
+
+Runs waiting microtasks and then the timers which are due, up to I<$max>
+of them if given. Timers set or coming due meanwhile wait for the next
+call, so one call never runs for long. Returns the number of timers run,
+or undef with C<$@> set if one of them threw; the others stay queued.
+
+=item pending_fd ( )
+
+Returns a file descriptor which becomes readable when C<run_pending()> has
+something to do: a timer is due, or a call left microtasks waiting with
+C<< microtasks => 'explicit' >>. It may also be readable when there is
+nothing to do, which costs one cheap call. The descriptor stays the same
+across C<reset()>, which drops the timers but not the watcher. See
+L</EVENT LOOPS>.
+
+=item pump_message_loop ( )
+
+Runs the tasks V8 has left for this context's isolate to run on the main
+thread, such as finishing off code compiled or garbage collected in the
+background, and returns how many ran. A few of them are run after every
+C<eval()> and C<run_pending()> anyway; this is for programs which go idle
+for a while.
+
+=item run_idle_tasks ( $seconds )
+
+Gives V8 up to I<$seconds> for optional work like garbage collection,
+which is best done while the program has nothing else to do.
+
+=item next_deadline ( )
+
+Returns when C<run_pending()> next has something to do, in seconds since
+the epoch like C<Time::HiRes::time()>, or undef if nothing is scheduled.
+
+=item compile ( $source[, $origin] )
+
+Compiles the JavaScript code given in I<$source> once and returns a
+C<JavaScript::V8::Script> object. Its C<run> method executes the code in
+this context and converts the result exactly like C<eval()>, without
+parsing the source again:
+
+  my $script = $context->compile('render(data)', 'render.js');
+  my $html = $script->run;
+
+A compilation error returns undef and sets C<$@>. Calling C<run> after the
+context has been destroyed dies.
+
+=item compile_function ( \@params, $body[, $origin] )
+
+Compiles I<$body> as the body of a JavaScript function taking the named
+parameters and returns it as a code reference. Arguments are converted
+from Perl on every call, but the source is only parsed once:
+
+  my $add = $context->compile_function([qw(a b)], 'return a + b');
+  print $add->(2, 3); # 5
+
+A compilation error returns undef and sets C<$@>.
+
+=item code_cache_stats ( )
+
+Returns a hash reference with the number of C<hits>, C<misses> and
+C<rejects> of the C<code_cache> directory for this context.
+
+=item conversion_stats ( )
+
+Returns a hash reference with the number of data structures converted
+through JSON (C<bulk_to_js>, C<bulk_to_perl>), those which were converted
+the usual way for being smaller than C<bulk_threshold> (C<direct_to_js>,
+C<direct_to_perl>), and those which could not be sent as JSON
+(C<bulk_bailouts>).
+
+=item reset ( )
+
+Replaces the global object with a fresh one, as if the context had just
+been created, but without the cost of creating a new context. Everything
+from before the reset is detached: scripts from C<compile()> can no longer
+be run and code references returned by C<eval()> die when called. Bound
+values have to be bound again. See L<JavaScript::V8::ContextPool>.
+
+=item eval_count ( )
+
+Returns the number of times C<eval()> or a compiled script's C<run()> has
+been called since the context was created or last reset.
+
+=item total_eval_count ( )
+
+Like C<eval_count()>, but not cleared by C<reset()>.
+
 =item set_flags_from_string ( $flags )
 
 Set or unset various flags supported by V8 (see
@@ -241,6 +659,40 @@ There is no need to call it in a loop.
 Most users of C<JavaScript::V8> will not need this. It can be a slow
 operation.
 
+=item adjust_amount_of_external_allocated_memory( $change_in_bytes )
+
+Tells V8 that memory outside its heap which is kept alive by JavaScript
+objects has grown (or, for a negative number, shrunk) by this many bytes,
+and returns the new total. V8 collects garbage more eagerly as this grows.
+
+Perl values wrapped for JavaScript (objects and functions) are already
+accounted for this way, with an estimate of their size taken when they
+are wrapped. This is only needed for memory the module cannot see, such
+as a buffer owned by an XS object.
+
+=item heap_statistics( )
+
+Returns a hash reference describing the heap of this context's isolate:
+C<total_heap_size>, C<total_heap_size_executable>, C<total_physical_size>,
+C<total_available_size>, C<used_heap_size>, C<heap_size_limit>,
+C<malloced_memory>, C<peak_malloced_memory> and C<external_memory>, all in
+bytes. Contexts sharing an isolate see the same numbers.
+
+It also includes counts for the context itself: C<wrapped_objects>, the
+number of Perl values currently wrapped for JavaScript (and JavaScript
+functions and objects wrapped for Perl), C<cached_prototypes>, the number
+of Perl packages with a cached JavaScript prototype, and C<cached_shapes>,
+the number of hash key sets seen with C<stable_shapes>.
+
+This is cheap enough to call on every request.
+
+=item heap_space_statistics( )
+
+Returns a hash reference keyed by V8 heap space name (such as
+C<new_space> or C<old_space>), each value being a hash reference of
+C<space_size>, C<space_used_size>, C<space_available_size> and
+C<physical_space_size> in bytes.
+
 =item name_global( $name )
 
 Give the global object a name that is accessible from JavaScript.  This is
@@ -250,4 +702,22 @@ correct API might be added).
 
 =back
 
+=head1 EVENT LOOPS
+
+JavaScript which uses timers or waits for promises can share a Perl event
+loop with other work. Watch C<pending_fd()> and call C<run_pending()>
+whenever it is readable; the descriptor becomes readable by itself when a
+timer comes due, so there is no need to keep a Perl timer in step. With
+L<AnyEvent>:
+
+  my $context = JavaScript::V8::Context->new(timers => 1, microtasks => 'explicit');
+  my $w = AnyEvent->io(
+      fh   => $context->pending_fd,
+      poll => 'r',
+      cb   => sub { $context->run_pending(100) },
+  );
+
+Loops which would rather schedule a timer of their own can ask for
+C<next_deadline()> after each call instead.
+
 =cut
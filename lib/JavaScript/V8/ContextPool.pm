@@ -0,0 +1,214 @@
+package JavaScript::V8::ContextPool;
+
+use strict;
+use warnings;
+
+use JavaScript::V8;
+use Time::HiRes ();
+
+sub new {
+    my($class, %args) = @_;
+
+    my $self = bless {
+        size             => exists $args{size} ? delete $args{size} : 4,
+        max_evals        => delete $args{max_evals} || 0,
+        max_heap_used_mb => delete $args{max_heap_used_mb} || 0,
+        init             => delete $args{init},
+        context          => delete $args{context} || {},
+        idle             => [],
+        stats            => {
+            hits       => 0,
+            misses     => 0,
+            resets     => 0,
+            recycled   => 0,
+            reset_time => 0,
+        },
+    }, $class;
+
+    push @{ $self->{idle} }, $self->_create for 1 .. $self->{size};
+
+    return $self;
+}
+
+sub get {
+    my($self) = @_;
+
+    if (my $context = pop @{ $self->{idle} }) {
+        $self->{stats}{hits}++;
+        return $context;
+    }
+
+    $self->{stats}{misses}++;
+    return $self->_create;
+}
+
+sub put {
+    my($self, $context) = @_;
+
+    return if @{ $self->{idle} } >= $self->{size};
+
+    if ($self->_exhausted($context)) {
+        $self->{stats}{recycled}++;
+        $context = $self->_create;
+    }
+    else {
+        my $start = Time::HiRes::time();
+        $context->reset;
+        $self->{init}->($context) if $self->{init};
+        $self->{stats}{reset_time} += Time::HiRes::time() - $start;
+        $self->{stats}{resets}++;
+    }
+
+    push @{ $self->{idle} }, $context;
+    return;
+}
+
+sub with {
+    my($self, $code) = @_;
+
+    my $context = $self->get;
+    my @result = wantarray ? eval { $code->($context) } : scalar eval { $code->($context) };
+    my $error = $@;
+    $self->put($context);
+    die $error if $error;
+
+    return wantarray ? @result : $result[0];
+}
+
+sub stats {
+    my($self) = @_;
+
+    my %stats = %{ $self->{stats} };
+    my $requests = $stats{hits} + $stats{misses};
+
+    $stats{idle} = @{ $self->{idle} };
+    $stats{hit_rate} = $requests ? $stats{hits} / $requests : 0;
+    $stats{reset_avg} = $stats{resets} ? $stats{reset_time} / $stats{resets} : 0;
+
+    return \%stats;
+}
+
+sub _exhausted {
+    my($self, $context) = @_;
+
+    return 1 if $self->{max_evals} && $context->total_eval_count >= $self->{max_evals};
+    return 1 if $self->{max_heap_used_mb}
+        && $context->heap_statistics->{used_heap_size} >= $self->{max_heap_used_mb} * 1024 * 1024;
+
+    return 0;
+}
+
+sub _create {
+    my($self) = @_;
+
+    my $context = JavaScript::V8::Context->new(%{ $self->{context} });
+    $self->{init}->($context) if $self->{init};
+
+    return $context;
+}
+
+1;
+
+=encoding utf8
+
+=head1 NAME
+
+JavaScript::V8::ContextPool - A pool of pre-warmed contexts
+
+=head1 SYNOPSIS
+
+  use JavaScript::V8::ContextPool;
+
+  my $pool = JavaScript::V8::ContextPool->new(
+      size      => 8,
+      max_evals => 1000,
+      context   => { time_limit => 1, snapshot => 'app.snapshot' },
+      init      => sub {
+          my($context) = @_;
+          $context->bind(log => sub { warn @_ });
+      },
+  );
+
+  my $html = $pool->with(sub {
+      my($context) = @_;
+      $context->bind(request => $request);
+      return $context->eval('render(request)');
+  });
+
+=head1 DESCRIPTION
+
+Creating a context and binding its globals for every request is slow,
+while reusing one context lets requests see each other's globals. A pool
+keeps a number of contexts ready and resets each one to a fresh global
+object when it is handed back, which is much cheaper than creating a new
+context (especially with a C<snapshot>).
+
+Resetting a context discards everything that belonged to its previous
+JavaScript global object: scripts from C<compile()> stop working and code
+references returned by C<eval()> die when called.
+
+=head1 INTERFACE
+
+=over
+
+=item new ( %parameters )
+
+=over
+
+=item size
+
+The number of idle contexts to keep, 4 by default. They are all created
+up front.
+
+=item context
+
+A hash reference of parameters for L<JavaScript::V8::Context/new>.
+
+=item init
+
+A code reference called with each new or reset context, to bind whatever
+globals every request expects.
+
+=item max_evals
+
+Once a context has run this many C<eval()> or C<run()> calls in total,
+over all its uses, it is thrown away instead of being reset when it is
+returned, to bound whatever state builds up outside the global object. 0
+(the default) means no limit.
+
+=item max_heap_used_mb
+
+Contexts are also thrown away instead of being reset when the used heap
+of their isolate exceeds this many megabytes. This is most useful with
+contexts which have their own isolate (see
+L<JavaScript::V8::Context/own_isolate>), since dropping a context does
+not shrink a heap shared with others. 0 (the default) means no limit.
+
+=back
+
+=item get ( )
+
+Returns an idle context, or creates a new one if none are left.
+
+=item put ( $context )
+
+Resets a context obtained from C<get()> and makes it available again. If
+the pool is already full the context is simply dropped.
+
+=item with ( $code )
+
+Calls I<$code> with a context from the pool and returns it afterwards,
+even if I<$code> dies. Returns whatever I<$code> returns.
+
+=item stats ( )
+
+Returns a hash reference with the number of C<hits> (requests served by
+an idle context), C<misses> (requests which had to create one), the
+C<hit_rate>, the number of C<resets> along with their total and average
+time in seconds (C<reset_time>, C<reset_avg>), the number of contexts
+C<recycled> because of C<max_evals> or C<max_heap_used_mb>, and the number
+currently C<idle>.
+
+=back
+
+=cut
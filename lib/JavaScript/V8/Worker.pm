@@ -0,0 +1,144 @@
+package JavaScript::V8::Worker;
+
+use strict;
+use warnings;
+
+use JavaScript::V8;
+
+sub new {
+    my($class, %args) = @_;
+
+    die "JavaScript::V8::Worker needs a script\n" unless defined $args{script};
+
+    return $class->_new($args{script}, $args{origin});
+}
+
+# The fd only becomes readable for a message, an error or the worker
+# stopping. The result is returned as is, so byte strings can still be
+# transferred back.
+sub wait_message {
+    my($self, $timeout) = @_;
+
+    if ($self->running) {
+        my $rin = '';
+        vec($rin, $self->fd, 1) = 1;
+        select($rin, undef, undef, $timeout);
+    }
+
+    return $self->get_message;
+}
+
+1;
+
+=encoding utf8
+
+=head1 NAME
+
+JavaScript::V8::Worker - Run a script on a background thread
+
+=head1 SYNOPSIS
+
+  use JavaScript::V8::Worker;
+
+  my $worker = JavaScript::V8::Worker->new(script => <<'JS');
+      onmessage = function(event) {
+          postMessage(event.data.map(function(n) { return n * n }));
+      };
+  JS
+
+  $worker->post_message([1, 2, 3]);
+  my $squares = $worker->wait_message;    # [1, 4, 9]
+
+=head1 DESCRIPTION
+
+A worker runs its script in an isolate of its own on a native thread, so
+it keeps running while Perl (and any context Perl uses) does something
+else. The two sides share nothing: values are copied in each direction
+with V8's structured clone, the same way browsers pass messages to web
+workers.
+
+Inside the worker the global object (also available as C<self>) has:
+
+=over
+
+=item postMessage ( value [, transfer ] )
+
+Sends a copy of I<value> to Perl. I<transfer> is an array of ArrayBuffers
+whose contents are moved along with the message instead of being copied;
+they are empty in the worker afterwards. Functions and other values which
+can't be cloned throw a C<DataCloneError>.
+
+=item onmessage
+
+Whatever function is assigned to it is called with an event object for
+every message from Perl, whose C<data> property is the value posted.
+
+=item close ( )
+
+Stops the worker once the current script or handler returns.
+
+=back
+
+Promise reactions run after the script and after each handler; V8's
+background tasks are run whenever the worker is idle. There are no timers.
+
+An exception thrown by the script or a handler is reported to Perl as an
+error (see C<get_message>). The worker keeps handling messages after an
+error in a handler, but stops if the script itself fails.
+
+=head1 INTERFACE
+
+=over
+
+=item new ( %parameters )
+
+Starts a worker. I<script> is the JavaScript source to run and I<origin>
+the name it is given in error messages ("worker" by default).
+
+=item post_message ( $value [, \@transfer ] )
+
+Sends a copy of I<$value> to the worker's C<onmessage> handler. Dies if
+I<$value> contains something which can't be cloned, such as a code
+reference. Messages to a worker which has stopped are dropped.
+
+I<@transfer> may list byte strings returned by JavaScript for an
+ArrayBuffer, DataView or Uint8Array (see
+L<JavaScript::V8::Context/bind_buffer>) which are part of I<$value>. Their
+buffers are moved to the worker rather than copied, and the strings are
+left empty. These must be the scalars the worker's messages returned, not
+copies of them, so keep a reference:
+
+  my $image = \ $worker->wait_message;
+  $worker->post_message({ image => $$image }, [$$image]);
+
+=item get_message ( )
+
+Returns the next message from the worker, converted as C<eval()> would
+convert it, or undef if there is none. If the next message is an error
+thrown in the worker, returns undef with C<$@> set to it.
+
+=item wait_message ( [ $timeout ] )
+
+Like C<get_message>, but waits up to I<$timeout> seconds (forever if
+undefined) for a message or error to arrive, or for the worker to stop.
+
+=item fd ( )
+
+Returns a file descriptor which is readable while messages are waiting,
+for use with C<select> or an event loop. It also becomes readable once
+when the worker stops.
+
+=item running ( )
+
+True until the worker has stopped, either because its script failed, it
+called C<close()> or it was terminated.
+
+=item terminate ( )
+
+Stops the worker, interrupting whatever script it is running, and waits
+for its thread to finish. Messages it has already sent can still be read.
+Dropping the last reference to a worker terminates it too.
+
+=back
+
+=cut
@@ -0,0 +1,34 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $shared = { name => 'shared' };
+my @records = map { { id => $_, parent => $shared } } 1 .. 1000;
+
+my $context = JavaScript::V8::Context->new;
+$context->bind(records => \@records);
+ok $context->eval('records[0].parent === records[999].parent'), 'shared references stay shared';
+ok $context->eval('records[0] !== records[1]'), 'distinct references stay distinct';
+
+my $back = $context->eval('var o = {}; var list = []; for (var i = 0; i < 1000; i++) list.push({ i: i, o: o }); list');
+is scalar(@$back), 1000, 'large result';
+is $back->[0]{o}, $back->[999]{o}, 'shared objects stay shared';
+isnt $back->[0], $back->[1], 'distinct objects stay distinct';
+
+my $acyclic = JavaScript::V8::Context->new(acyclic => 1);
+$acyclic->bind(records => \@records);
+is $acyclic->eval('records[999].parent.name'), 'shared', 'converted without tracking';
+ok !$acyclic->eval('records[0].parent === records[999].parent'), 'shared references are copied';
+
+$back = $acyclic->eval('var o = { x: 1 }; [o, o]');
+is_deeply $back, [ { x => 1 }, { x => 1 } ], 'results converted without tracking';
+isnt $back->[0], $back->[1], 'shared objects are copied';
+
+my $deep = [];
+$deep = [ $deep ] for 1 .. 100;
+$acyclic->bind(deep => $deep);
+is $acyclic->eval('var d = deep, n = 0; while (d.length) { d = d[0]; n++ } n'), 100, 'deep structures';
+
+done_testing;
@@ -47,4 +47,10 @@ is $context->eval('(function(x) { return x; })')->($zzz), undef, 'undef roundtri
 
 is $context->eval('(function(f) { try { f() } catch(e) { return "ok"; } })')->(sub { die 'err' }), 'ok', 'caught perl error in js';
 
+$context->bind(count => sub { scalar @_ });
+is $context->eval('count()'), 0, 'no arguments';
+is $context->eval('count(1, "two", [3])'), 3, 'all arguments passed';
+is $context->eval('count.apply(null, [1, 2])'), 2, 'arguments via apply';
+is $context->eval('typeof count'), 'function', 'bound sub is a function';
+
 done_testing;
@@ -0,0 +1,56 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new;
+
+my %config = (
+    name  => 'app',
+    db    => { host => 'localhost', ports => [ 5432, 5433 ] },
+    1     => 'one',
+);
+$context->bind_view(config => \%config);
+
+is $context->eval('config.name'), 'app', 'reads a key';
+is $context->eval('config.db.ports[1]'), 5433, 'reads nested data';
+is $context->eval('config[1]'), 'one', 'reads integer-like keys';
+ok !defined $context->eval('config.missing'), 'missing keys are undefined';
+is $context->eval('"db" in config'), 1, 'in';
+is $context->eval('Object.keys(config).sort().join()'), '1,db,name', 'keys';
+
+$config{name} = 'changed';
+is $context->eval('config.name'), 'changed', 'sees Perl changes';
+
+$context->eval('config.db.port = 5432; config.added = { list: [1, 2] }; delete config[1]');
+is $config{db}{port}, 5432, 'writes reach Perl';
+is_deeply $config{added}, { list => [ 1, 2 ] }, 'objects are converted on write';
+ok !exists $config{1}, 'delete reaches Perl';
+
+ok $context->eval('config.db === config.db'), 'nested views are reused';
+is $context->eval('config'), \%config, 'views convert back to the Perl data';
+
+my @list = (1, 2, 3);
+$context->bind_view(list => \@list);
+is $context->eval('list.length'), 3, 'length';
+is $context->eval('list.map(function(x) { return x * 2 }).join()'), '2,4,6', 'Array.prototype methods';
+$context->eval('list[3] = 4; list[0] = "first"');
+is_deeply \@list, [ 'first', 2, 3, 4 ], 'array writes reach Perl';
+$context->eval('list.length = 2');
+is_deeply \@list, [ 'first', 2 ], 'length can be set';
+is $context->eval('Object.keys(list).join()'), '0,1', 'array keys';
+
+my %big = map { ("key$_" => $_) } 1 .. 100_000;
+$context->bind_view(big => \%big);
+is $context->eval('big.key99999'), 99999, 'large hash';
+
+eval { $context->bind_view(scalar => 1) };
+like $@, qr/bind_view needs an array or hash reference/, 'only arrays and hashes';
+
+$context->reset;
+ok !defined $context->eval('typeof config == "undefined" ? undefined : 1'), 'views go with reset';
+$context->bind_view(config => \%config);
+is $context->eval('config.db.host'), 'localhost', 'views work after reset';
+
+done_testing;
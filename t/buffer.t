@@ -0,0 +1,61 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new;
+
+my $bytes = join '', map { chr } 0 .. 255;
+$context->bind_buffer(bytes => $bytes);
+
+is $context->eval('bytes instanceof Uint8Array'), 1, 'bound as a Uint8Array';
+is $context->eval('bytes.length'), 256, 'length';
+is $context->eval('bytes[200]'), 200, 'reads the bytes';
+
+$context->eval('bytes[0] = 42');
+is ord($bytes), 42, 'writes are shared with Perl';
+
+eval { $bytes .= 'x' };
+like $@, qr/read-only/, 'read-only while JavaScript holds it';
+
+$context->bind_buffer(again => $bytes);
+ok $context->eval('again.buffer === bytes.buffer'), 'one ArrayBuffer per string';
+
+my $result = $context->eval('new Uint8Array([1, 2, 3, 255])');
+is length $result, 4, 'Uint8Array comes back as bytes';
+is $result, "\x01\x02\x03\xff", 'with the right bytes';
+ok !utf8::is_utf8($result), 'as a byte string';
+
+my $view = $context->eval('var u = new Uint8Array(16); u[4] = 7; u.subarray(4, 8)');
+is $view, "\x07\0\0\0", 'subarrays';
+is length $context->eval('new ArrayBuffer(10)'), 10, 'ArrayBuffer';
+is $context->eval('new DataView(new ArrayBuffer(8), 2, 3)'), "\0\0\0", 'DataView';
+is $context->eval('new Uint8Array(0)'), '', 'empty';
+
+my $shared = \ $context->eval('var shared = new Uint8Array(4); shared');
+$context->eval('shared[1] = 65');
+is substr($$shared, 1, 1), 'A', 'results share memory';
+
+my $text = \ $context->eval('var text = new Uint8Array(3); text.set([65, 66, 67]); text');
+is unpack('p', pack('p', $$text)), 'ABC', 'NUL-terminated';
+is unpack('p', pack('p', $context->eval('text.subarray(0, 2)'))), 'AB', 'views short of the end too';
+
+$context->bind(back => $$shared);
+ok $context->eval('back === shared'), 'results go back as the same object';
+
+my $data = $context->eval('({ image: new Uint8Array([80, 78, 71]) })');
+is $data->{image}, 'PNG', 'nested buffers';
+
+eval { $context->bind_buffer(wide => "\x{263a}") };
+like $@, qr/byte string/, 'wide strings refused';
+
+undef $context;
+is $$shared, "\0A\0\0", 'results outlive their context';
+
+my $own = JavaScript::V8::Context->new(own_isolate => 1);
+my $kept = \ $own->eval('new Uint8Array([1, 2])');
+undef $own;
+is $$kept, "\x01\x02", 'and their isolate';
+
+done_testing;
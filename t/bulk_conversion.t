@@ -0,0 +1,73 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+use utf8;
+
+my $context = JavaScript::V8::Context->new(bulk_threshold => 100);
+
+my @records = map { { id => $_, name => "näme $_", score => $_ / 4, tags => [ 'a', "\x{263a}" ] } } 1 .. 100;
+$context->bind(records => \@records);
+is $context->eval('records.length'), 100, 'bound in bulk';
+is $context->eval('records[99].name'), 'näme 100', 'latin-1 strings';
+is $context->eval('records[1].score'), 0.5, 'numbers';
+is $context->eval('records[0].tags[1]'), "\x{263a}", 'utf-8 strings';
+is $context->conversion_stats->{bulk_to_js}, 1, 'counted';
+
+$context->bind(small => [ 1, 2, 3 ]);
+is $context->eval('small.length'), 3, 'small data';
+is $context->conversion_stats->{direct_to_js}, 1, 'converted directly';
+
+$context->bind(holey => [ (1) x 100, undef ]);
+ok $context->eval('holey[100] === undefined'), 'undef stays undefined';
+is $context->conversion_stats->{bulk_bailouts}, 1, 'bailed out';
+
+my $back = $context->eval('var list = []; for (var i = 0; i < 200; i++) list.push({ i: i, s: "x☺\n" + i, f: i + 0.5, b: i % 2 == 0, n: null }); list');
+is scalar(@$back), 200, 'result in bulk';
+is_deeply $back->[3], { i => 3, s => "x\x{263a}\n3", f => 3.5, b => 0, n => undef }, 'values';
+is $context->conversion_stats->{bulk_to_perl}, 1, 'counted';
+
+$back = $context->eval('var o = { list: [] }; o.self = o; for (var i = 0; i < 200; i++) o.list.push(i); o');
+is $back->{self}, $back, 'cycles are converted the usual way';
+
+my $prefix = 'var big = []; for (var i = 0; i < 200; i++) big.push(i);';
+my $bailouts = $context->conversion_stats->{bulk_bailouts};
+my $direct = $context->conversion_stats->{direct_to_perl};
+
+$back = $context->eval("$prefix ({ big: big, f: function() { return 1 } })");
+is ref $back->{f}, 'CODE', 'nested functions are kept';
+
+$back = $context->eval("$prefix ({ big: big, u: undefined, nan: NaN, inf: -Infinity })");
+ok exists $back->{u}, 'undefined properties are kept';
+ok $back->{nan} != $back->{nan}, 'NaN is kept';
+ok $back->{inf} < 0 && $back->{inf} * 0 != 0, 'Infinity is kept';
+
+$back = $context->eval("$prefix ({ big: big, d: new Date(0), t: new Int32Array([1, 2]), m: new Map([[1, 2]]) })");
+isnt ref $back->{d}, '', 'nested dates are not strings';
+is_deeply $back->{t}, [1, 2], 'nested typed arrays';
+
+$back = $context->eval("$prefix ({ big: big, get g() { return 7 }, o: { toJSON: function() { return 'x' } } })");
+is $back->{g}, 7, 'getters';
+is ref $back->{o}{toJSON}, 'CODE', 'toJSON is not called';
+
+$back = $context->eval("$prefix var shared = { a: 1 }; ({ big: big, x: shared, y: shared })");
+is $back->{x}, $back->{y}, 'shared references stay shared';
+
+my $perl = bless { perl => 1 }, 'Perl::Thing';
+$context->bind(perl => $perl);
+$back = $context->eval("$prefix ({ big: big, p: perl })");
+is $back->{p}, $perl, 'Perl data keeps its identity';
+
+is $context->conversion_stats->{bulk_bailouts}, $bailouts + 6, 'all bailed out';
+is $context->conversion_stats->{direct_to_perl}, $direct, 'not counted as small';
+
+$context->eval('var calls = 0; var small = { get g() { calls++; return 1 } }');
+$context->eval('small');
+is $context->eval('calls'), 1, 'getters run once';
+
+$back = $context->eval('({ a: 1 })');
+is_deeply $back, { a => 1 }, 'small result';
+is $context->conversion_stats->{direct_to_perl}, $direct + 1, 'converted directly';
+
+done_testing;
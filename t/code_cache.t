@@ -0,0 +1,68 @@
+#!/usr/bin/perl
+use Test::More;
+use File::Temp qw(tempdir);
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $dir = tempdir(CLEANUP => 1);
+my $source = join "\n", map { "function f$_(x) { return x + $_; }" } 1 .. 200;
+$source .= "\nf200(1)";
+
+my $source_file = "$dir/bundle.js";
+open my $fh, '>', $source_file or die $!;
+print $fh $source;
+close $fh;
+
+# V8 keeps an in-memory compilation cache per isolate, so reading the disk
+# cache back has to happen in a fresh process.
+sub eval_in_child {
+    my $pid = open my $out, '-|';
+    die "fork: $!" unless defined $pid;
+    if (!$pid) {
+        exec $^X, (map { "-I$_" } @INC), '-MJavaScript::V8', '-e', q{
+            my($dir, $file) = @ARGV;
+            my $source = do { local(@ARGV, $/) = $file; <> };
+            my $context = JavaScript::V8::Context->new(code_cache => $dir);
+            my $result = $context->eval($source, 'bundle.js');
+            print join ' ', $result, @{ $context->code_cache_stats }{qw(hits misses rejects)};
+        }, $dir, $source_file;
+    }
+    local $/;
+    return scalar <$out>;
+}
+
+{
+    my $context = JavaScript::V8::Context->new(code_cache => $dir);
+    is $context->eval($source, 'bundle.js'), 201, 'first eval';
+    is_deeply $context->code_cache_stats, { hits => 0, misses => 1, rejects => 0 }, 'miss';
+}
+
+my @files = glob "$dir/*.v8cache";
+is scalar @files, 1, 'cache written';
+
+is eval_in_child(), '201 1 0 0', 'another process hits the cache';
+
+open $fh, '>', $files[0] or die $!;
+print $fh "not a code cache" x 10;
+close $fh;
+
+is eval_in_child(), '201 0 0 1', 'corrupt cache is rejected';
+is eval_in_child(), '201 1 0 0', 'and replaced';
+
+{
+    my $context = JavaScript::V8::Context->new(code_cache => $dir);
+    is $context->compile($source, 'bundle.js')->run, 201, 'compile uses the cache';
+    is $context->eval($source, 'other.js'), 201, 'origin is part of the key';
+    is $context->code_cache_stats->{misses}, 1, 'different origin misses';
+
+    ok !defined $context->eval('1 +', 'broken.js'), 'syntax error';
+    like $@, qr/SyntaxError/, 'error reported';
+    is $context->code_cache_stats->{misses}, 1, 'failed compiles are not counted';
+}
+
+my $new_dir = "$dir/sub";
+JavaScript::V8::Context->new(code_cache => $new_dir);
+ok -d $new_dir, 'directory created';
+
+done_testing;
@@ -0,0 +1,49 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new();
+
+$context->eval('var counter = 0;');
+
+my $script = $context->compile('++counter', 'counter.js');
+isa_ok $script, 'JavaScript::V8::Script';
+is $script->run, $_, "run $_" for 1 .. 3;
+is $context->eval('counter'), 3, 'runs in the context it was compiled in';
+
+is_deeply $context->compile('({ a: [1, 2] })')->run, { a => [1, 2] }, 'result conversion';
+
+ok !defined $context->compile('1 +', 'broken.js'), 'syntax error';
+like $@, qr/SyntaxError.*broken\.js/, 'syntax error reported with origin';
+
+my $thrower = $context->compile('throw new Error("boom")');
+ok !defined $thrower->run, 'exception returns undef';
+like $@, qr/boom/, 'exception in $@';
+is $script->run, 4, '$@ is cleared by a successful run';
+ok !$@, '$@ empty';
+
+my $add = $context->compile_function([qw(a b)], 'return a + b');
+is ref $add, 'CODE', 'compile_function returns a code reference';
+is $add->(2, 3), 5, 'arguments are passed';
+is $add->('a', 'b'), 'ab', 'strings are passed';
+
+my $keys = $context->compile_function(['o'], 'return Object.keys(o).sort()');
+is_deeply $keys->({ x => 1, y => 2 }), [qw(x y)], 'structures are passed';
+
+ok !defined $context->compile_function([], 'return }'), 'syntax error in function body';
+ok $@, 'error set';
+
+eval { $context->compile_function('a', 'return a') };
+like $@, qr/array reference/, 'parameters must be an array reference';
+
+{
+    my $ctx = JavaScript::V8::Context->new();
+    my $orphan = $ctx->compile('1');
+    undef $ctx;
+    eval { $orphan->run };
+    like $@, qr/context is no more/, 'run after the context is gone';
+}
+
+done_testing;
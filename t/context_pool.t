@@ -0,0 +1,77 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8::ContextPool;
+use strict;
+use warnings;
+
+{
+    my $context = JavaScript::V8::Context->new;
+    $context->bind(x => 1);
+    $context->eval('var y = 2; Array.prototype.extra = 1;');
+    my $fn = $context->eval('(function() { return 42; })');
+    my $script = $context->compile('y');
+    is $context->eval_count, 2, 'eval count';
+
+    $context->reset;
+    is $context->eval_count, 0, 'eval count reset';
+    is $context->total_eval_count, 2, 'total eval count survives reset';
+    is $context->eval('typeof x + typeof y'), 'undefinedundefined', 'globals are gone';
+    is $context->eval('[].extra'), undef, 'builtins are fresh';
+
+    eval { $fn->() };
+    like $@, qr/context is no more/, 'old functions are detached';
+    eval { $script->run };
+    like $@, qr/context is no more/, 'old scripts are detached';
+
+    $context->bind(f => sub { 'perl' });
+    is $context->eval('f()'), 'perl', 'binding works after reset';
+}
+
+my $inits = 0;
+my $pool = JavaScript::V8::ContextPool->new(
+    size      => 2,
+    max_evals => 3,
+    init      => sub { $inits++; shift->bind(greeting => 'hello') },
+);
+is $inits, 2, 'contexts created up front';
+
+my $first = $pool->get;
+is $first->eval('greeting'), 'hello', 'initialised';
+$first->eval('var leaked = 1');
+$pool->put($first);
+
+is $pool->with(sub { shift->eval('typeof leaked') }), 'undefined', 'no state leaks between uses';
+is $pool->with(sub { shift->eval('greeting') }), 'hello', 'init runs after reset';
+
+my @contexts = map { $pool->get } 1 .. 3;
+$pool->put($_) for @contexts;
+
+my $stats = $pool->stats;
+is $stats->{hits}, 5, 'hits';
+is $stats->{misses}, 1, 'misses';
+is $stats->{idle}, 2, 'pool does not grow past its size';
+ok $stats->{hit_rate} > 0.8 && $stats->{hit_rate} < 0.9, 'hit rate';
+ok $stats->{resets} >= 4, 'resets counted';
+ok defined $stats->{reset_avg}, 'reset latency';
+
+my $context = $pool->get;
+$context->eval('1') for 1 .. 3;
+$pool->put($context);
+is $pool->stats->{recycled}, 1, 'context recycled after max_evals';
+
+my $single = JavaScript::V8::ContextPool->new(size => 1, max_evals => 3);
+my @used;
+for (1 .. 4) {
+    my $context = $single->get;
+    push @used, $context;
+    $context->eval('1');
+    $single->put($context);
+}
+is $single->stats->{recycled}, 1, 'evals counted across checkouts';
+ok $used[2] == $used[0] && $used[3] != $used[0], 'a fresh context after max_evals uses';
+
+eval { $pool->with(sub { die "oops\n" }) };
+is $@, "oops\n", 'errors propagate';
+is $pool->stats->{idle}, 2, 'context returned after an error';
+
+done_testing;
@@ -1,5 +1,5 @@
 #!/usr/bin/perl
-use Test::More tests => 14 + 2*1000;
+use Test::More tests => 17 + 2*1000;
 use JavaScript::V8;
 use strict;
 use warnings;
@@ -68,4 +68,10 @@ my $f3 = $f2->($f1)->($f2);
 is $f1, $f2, 'roundtrip - same perl object';
 is $f1, $f3, 'roundtrip - same perl object';
 
+my $records = $context->eval('var r = []; for (var i = 0; i < 100; i++) r.push({ id: i, "\u00e9": i * 2 }); r');
+is_deeply $records->[99], { id => 99, "\x{e9}" => 198 }, 'records share keys';
+is_deeply $context->eval('({ 1: "a", 20: "b" })'), { 1 => 'a', 20 => 'b' }, 'index keys';
+is_deeply $context->eval('[{ 0: "x", k: 1 }, { 0: "y", k: 2 }]'), [ { 0 => 'x', k => 1 }, { 0 => 'y', k => 2 } ], 'index keys next to named ones';
+is_deeply $context->eval('var p = { inherited: 1 }; var o = Object.create(p); o.own = 2; o'), { own => 2 }, 'own properties only';
+
 done_testing;
@@ -0,0 +1,32 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(own_isolate => 1);
+
+my $base = $context->adjust_amount_of_external_allocated_memory(0);
+is $context->adjust_amount_of_external_allocated_memory(1000), $base + 1000, 'adjusts up';
+is $context->adjust_amount_of_external_allocated_memory(-1000), $base, 'adjusts down';
+
+my $big = bless { data => 'x' x 1_000_000 }, 'Big';
+$context->bind(big => $big);
+my $held = $context->adjust_amount_of_external_allocated_memory(0);
+ok $held - $base >= 1_000_000, 'wrapped object is accounted for';
+is $context->heap_statistics->{external_memory}, $held, 'reported in heap_statistics';
+
+my $list = bless [ map { 'y' x 1000 } 1 .. 10_000 ], 'List';
+$context->bind(list => $list);
+my $sampled = $context->adjust_amount_of_external_allocated_memory(0) - $held;
+ok $sampled >= 10_000_000 && $sampled < 20_000_000, 'large arrays are sampled';
+
+$context->eval('big = null; list = null');
+$context->idle_notification;
+ok $context->adjust_amount_of_external_allocated_memory(0) < $held, 'released when collected';
+
+$context->bind(again => $big);
+undef $context;
+pass 'context destroyed while holding wrapped objects';
+
+done_testing;
@@ -0,0 +1,57 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+BEGIN {
+    eval { require Future; 1 }
+        or plan skip_all => 'Future is not installed';
+}
+
+my $context = JavaScript::V8::Context->new(futures => 1);
+
+my %pending;
+$context->bind(fetch => sub { $pending{$_[0]} = Future->new });
+
+$context->eval('var results = []; Promise.all([fetch("a"), fetch("b")]).then(function(v) { results = v })');
+is_deeply [ sort keys %pending ], [qw(a b)], 'both requests started';
+is $context->eval('results.length'), 0, 'nothing yet';
+
+$pending{b}->done('B');
+$pending{a}->done('A');
+is $context->eval('results.join()'), 'A,B', 'promise resolved from futures';
+
+$context->eval('var failure; fetch("c").catch(function(e) { failure = e })');
+$pending{c}->fail("broken\n");
+is $context->eval('failure'), "broken\n", 'failures reject';
+
+is $context->eval_async('fetch("d")'), undef, 'pending future';
+like $@, qr/never settled/, 'cannot be waited for';
+$context->bind(done => Future->done(42));
+is $context->eval_async('done'), 42, 'completed future';
+
+my $future = $context->eval('Promise.resolve(7)');
+isa_ok $future, 'Future';
+ok $future->is_done, 'done after microtasks';
+is $future->get, 7, 'value';
+
+$future = $context->eval('Promise.reject("no")');
+ok $future->is_failed, 'failed';
+is $future->failure, 'no', 'reason';
+
+$future = $context->eval('new Promise(function(resolve) { later = resolve })');
+ok !$future->is_ready, 'pending';
+$context->eval('later({ x: 1 })');
+is_deeply $future->get, { x => 1 }, 'resolved later';
+
+$future = $context->eval('Promise.resolve(1).then(function() { throw "late" })');
+$context->eval('1');
+ok $future->is_failed, 'rejected after a reaction';
+is $future->failure, 'late', 'reason';
+
+my $plain = JavaScript::V8::Context->new;
+my $promise = $plain->eval('Promise.resolve(7)');
+ok !(ref $promise && eval { $promise->isa('Future') }), 'promises stay objects without futures';
+
+done_testing;
@@ -0,0 +1,30 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = eval { JavaScript::V8::Context->new(max_heap_mb => 64, initial_heap_mb => 8) };
+plan skip_all => 'max_heap_mb needs V8 6.5 or later' if !$context && $@ =~ /needs V8 6.5/;
+
+is $context->eval('var small = []; for (var i = 0; i < 1000; i++) small.push({ i: i }); small.length'), 1000, 'normal allocation';
+
+ok !defined $context->eval('var hog = []; for (;;) hog.push(new Array(10000).join("x") + Math.random());'), 'runaway allocation fails';
+like $@, qr/heap limit exceeded/, 'heap limit error';
+
+is $context->eval('hog = null; "released"'), 'released', 'data can be released';
+is $context->eval('small.length'), 1000, 'context survives';
+
+ok !defined $context->eval('var hog2 = []; for (;;) hog2.push(new Array(10000).join("y") + Math.random());'), 'limit applies again';
+like $@, qr/heap limit exceeded/, 'heap limit error again';
+
+my $grow = $context->eval('(function() { hog2 = null; var hog3 = []; for (;;) hog3.push(new Array(10000).join("z") + Math.random()); })');
+ok !eval { $grow->(); 1 }, 'limit applies to function calls';
+like $@, qr/heap limit exceeded/, 'reported there too';
+ok !defined $context->eval('throw new Error("unrelated")'), 'a later error';
+like $@, qr/unrelated/, 'is reported as itself';
+
+my $other = JavaScript::V8::Context->new;
+is $other->eval('"unaffected"'), 'unaffected', 'other contexts are unaffected';
+
+done_testing;
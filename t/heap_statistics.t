@@ -0,0 +1,46 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use JavaScript::V8::ContextPool;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(own_isolate => 1);
+
+my $stats = $context->heap_statistics;
+for my $key (qw(total_heap_size total_heap_size_executable total_physical_size
+                total_available_size used_heap_size heap_size_limit
+                malloced_memory peak_malloced_memory external_memory)) {
+    ok defined $stats->{$key}, "has $key";
+}
+ok $stats->{used_heap_size} > 0, 'heap in use';
+ok $stats->{used_heap_size} <= $stats->{total_heap_size}, 'used within total';
+is $stats->{wrapped_objects}, 0, 'no wrapped objects yet';
+is $stats->{cached_prototypes}, 0, 'no prototypes yet';
+
+my $before = $stats->{used_heap_size};
+$context->eval('var big = []; for (var i = 0; i < 100000; i++) big.push({ i: i });');
+ok $context->heap_statistics->{used_heap_size} > $before, 'heap grows';
+
+$context->bind(f => sub { 1 });
+$context->bind(obj => bless {}, 'Some::Package');
+my $fn = $context->eval('(function() {})');
+$stats = $context->heap_statistics;
+is $stats->{wrapped_objects}, 3, 'wrapped objects counted';
+is $stats->{cached_prototypes}, 1, 'prototypes counted';
+
+my $spaces = $context->heap_space_statistics;
+ok exists $spaces->{old_space}, 'old space reported';
+ok defined $spaces->{$_}{space_used_size}, "$_ has sizes" for keys %$spaces;
+
+my $pool = JavaScript::V8::ContextPool->new(
+    size             => 1,
+    max_heap_used_mb => 1,
+    context          => { own_isolate => 1 },
+);
+my $pooled = $pool->get;
+$pooled->eval('var big = []; for (var i = 0; i < 200000; i++) big.push({ i: i });');
+$pool->put($pooled);
+is $pool->stats->{recycled}, 1, 'pool recycles contexts with large heaps';
+
+done_testing;
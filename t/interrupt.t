@@ -4,10 +4,21 @@ use JavaScript::V8;
 my $c = JavaScript::V8::Context->new(time_limit => 2);
 $c->eval(q{ for(var i = 1; i; i++) { } });
 ok $@, "timed out with error";
+like $@, qr/terminated/i;
 
-{
-  local $TODO = "return correct error on timeout";
-  like $@, qr/terminated/i;
-}
+is $c->eval('1 + 1'), 2, 'context still usable after timeout';
+
+my $fast = JavaScript::V8::Context->new(time_limit => 0.05);
+my $start = time;
+$fast->eval(q{ for(;;) { } });
+like $@, qr/terminated/i, 'millisecond limit';
+cmp_ok time - $start, '<=', 1, 'millisecond limit fires quickly';
+
+is $fast->eval('2 + 2'), 4, 'short eval within limit' for 1 .. 1000;
+
+my $other = JavaScript::V8::Context->new;
+$other->bind(spin => sub { $fast->eval(q{ for(;;) { } }); $@ });
+like $other->eval('spin()'), qr/terminated/i, 'nested limit';
+is $other->eval('"alive"'), 'alive', 'only the timed out execution is terminated';
 
 done_testing;
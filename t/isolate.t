@@ -0,0 +1,50 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $shared = JavaScript::V8::Context->new;
+my $own = JavaScript::V8::Context->new(own_isolate => 1);
+my $other = JavaScript::V8::Context->new(own_isolate => 1);
+
+$_->bind(double => sub { 2 * shift }) for $shared, $own, $other;
+is $_->eval('double(21)'), 42, 'bound functions work' for $shared, $own, $other;
+
+is_deeply $own->eval('({ a: [1, { b: "c" }] })'), { a => [1, { b => 'c' }] }, 'conversion in an own isolate';
+
+my $fn = $own->eval('(function(x) { return x + 1; })');
+is $fn->(1), 2, 'functions from an own isolate';
+
+my $script = $other->compile('double(2)');
+is $script->run, 4, 'compiled scripts in an own isolate';
+
+# A Perl value crossing isolates is converted, not shared
+$other->bind(from_own => $own->eval('({ x: 1 })'));
+is $other->eval('from_own.x'), 1, 'values can be copied between isolates';
+
+{
+    my $limited = JavaScript::V8::Context->new(own_isolate => 1, time_limit => 0.1);
+    $shared->bind(spin => sub { $limited->eval('for(;;) {}'); $@ });
+    like $shared->eval('spin() + " " + double(1)'), qr/terminated.* 2$/, 'termination only affects the isolate that timed out';
+}
+
+my $g1 = JavaScript::V8::Context->new(isolate_group => 'tenant');
+my $g2 = JavaScript::V8::Context->new(isolate_group => 'tenant');
+$g1->eval('var x = 1');
+is $g2->eval('typeof x'), 'undefined', 'contexts in a group still have separate globals';
+
+for (1 .. 20) {
+    my $c = JavaScript::V8::Context->new(own_isolate => 1);
+    $c->bind(obj => bless {}, 'Foo');
+    $c->bind(f => sub { 1 });
+    my $keep = $c->eval('(function() { return f(); })');
+    undef $c;
+    eval { $keep->() };
+    like $@, qr/context is no more/, 'functions outlive a disposed isolate safely';
+}
+
+undef $own;
+is $other->eval('double(5)'), 10, 'disposing one isolate leaves the others';
+
+done_testing;
@@ -0,0 +1,68 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(lazy_results => 1);
+
+$context->eval('var calls = 0; var data = { get counted() { calls++; return 1 }, name: "x", rows: [1, [2, 3], { deep: true }] }');
+
+my $data = $context->eval('data');
+is ref $data, 'HASH', 'objects are hashes';
+ok tied %$data, 'which are tied';
+is $context->eval('calls'), 0, 'nothing fetched yet';
+is $data->{counted}, 1, 'fetch';
+is $context->eval('calls'), 1, 'fetched on demand';
+
+ok exists $data->{name}, 'exists';
+ok !exists $data->{missing}, 'not exists';
+is_deeply [ sort keys %$data ], [qw(counted name rows)], 'keys';
+ok scalar(%$data), 'scalar';
+
+my $rows = $data->{rows};
+is ref $rows, 'ARRAY', 'arrays are arrays';
+is scalar(@$rows), 3, 'size';
+is $rows->[1][0], 2, 'nested arrays';
+ok $rows->[2]{deep}, 'nested objects';
+
+$data->{name} = 'y';
+is $context->eval('data.name'), 'y', 'store reaches JavaScript';
+delete $data->{name};
+ok !$context->eval('"name" in data'), 'delete reaches JavaScript';
+push @$rows, 4;
+is $context->eval('data.rows.length'), 4, 'push';
+$#$rows = 0;
+is $context->eval('data.rows.length'), 1, 'storesize';
+
+is $context->eval('data'), $data, 'the same proxy comes back for the same object';
+$context->bind(again => $data);
+ok $context->eval('again === data'), 'proxies convert back to their object';
+
+my $copy = tied(%$data)->materialize;
+ok !tied %$copy, 'materialize copies';
+ok !tied @{ $copy->{rows} }, 'recursively';
+is_deeply $copy, { counted => 1, rows => [1] }, 'materialized data';
+
+my $child = $context->eval('Object.create({ inherited: 1 }, { own: { value: 2, enumerable: true } })');
+is_deeply [ keys %$child ], ['own'], 'keys are own properties';
+is scalar(%$child), 1, 'and so is the count';
+is_deeply tied(%$child)->materialize, { own => 2 }, 'as when materialized';
+
+{
+    my $owned = JavaScript::V8::Context->new(lazy_results => 1, own_isolate => 1);
+    my $hash = $owned->eval('({ a: 1, b: 2 })');
+    my($key) = each %$hash;
+    undef $owned;
+    undef $hash;
+    pass 'iteration outlives its isolate';
+}
+
+$context->reset;
+eval { my $x = $data->{rows} };
+like $@, qr/V8 context is no more/, 'proxies die after reset';
+
+my $plain = JavaScript::V8::Context->new;
+ok !tied %{ $plain->eval('({ a: 1 })') }, 'off by default';
+
+done_testing;
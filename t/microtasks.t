@@ -0,0 +1,39 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new;
+$context->eval('var log = []; Promise.resolve().then(function() { log.push("then") })');
+is $context->eval('log.join()'), 'then', 'microtasks run after eval';
+
+my $later = $context->eval('(function() { Promise.resolve().then(function() { log.push("call") }) })');
+$later->();
+is $context->eval('log.join()'), 'then,call', 'and after calls';
+
+is $context->eval_async('Promise.resolve(42)'), 42, 'fulfilled';
+is $context->eval_async('(async function() { var a = await 20; var b = await Promise.resolve(22); return a + b })()'), 42, 'async functions';
+is_deeply $context->eval_async('Promise.resolve({ a: [1, 2] })'), { a => [1, 2] }, 'converted';
+is $context->eval_async('7'), 7, 'plain values';
+
+ok !defined $context->eval_async('Promise.reject(new Error("nope"))'), 'rejected';
+like $@, qr/Error: nope/, 'rejection in $@';
+
+ok !defined $context->eval_async('new Promise(function() {})'), 'never settled';
+like $@, qr/never settled/, 'reported';
+
+my $explicit = JavaScript::V8::Context->new(microtasks => 'explicit');
+$explicit->eval('var done = 0; Promise.resolve().then(function() { done = 1 })');
+is $explicit->eval('done'), 0, 'explicit microtasks wait';
+$explicit->run_microtasks;
+is $explicit->eval('done'), 1, 'until run';
+is $explicit->eval_async('Promise.resolve(1).then(function(v) { return v + 1 })'), 2, 'eval_async runs them';
+
+eval { JavaScript::V8::Context->new(microtasks => 'explicit', isolate_group => 'shared') };
+like $@, qr/needs an isolate of its own/, 'explicit microtasks are not shared';
+
+eval { JavaScript::V8::Context->new(microtasks => 'sometimes') };
+like $@, qr/microtasks must be auto or explicit/, 'bad policy';
+
+done_testing;
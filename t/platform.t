@@ -0,0 +1,67 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use Time::HiRes qw(sleep);
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(platform_threads => 2);
+
+$context->eval('function hot(n) { var s = 0; for (var i = 0; i < n; i++) s += i; return s } for (var i = 0; i < 1000; i++) hot(1000)');
+my $ran = $context->pump_message_loop;
+ok defined $ran && $ran >= 0, 'message loop pumped';
+
+$context->eval('var garbage = []; for (var i = 0; i < 100000; i++) garbage.push({ i: i }); garbage = null');
+$context->run_idle_tasks(0.01);
+is $context->eval('hot(10)'), 45, 'still works after idle tasks';
+
+# Asynchronous WebAssembly compilation decodes on a worker thread, then
+# posts the rest to the main thread, so it only finishes once the message
+# loop is pumped
+SKIP: {
+    skip 'no WebAssembly', 3 unless $context->eval('typeof WebAssembly') eq 'object';
+
+    $context->eval('var compiled = false, bytes = new Uint8Array([0, 0x61, 0x73, 0x6d, 1, 0, 0, 0])');
+    my $nested = 0;
+    $context->bind(wait => sub {
+        for (1 .. 50) {
+            $nested += $context->pump_message_loop;
+            sleep 0.02;
+        }
+    });
+    $context->eval('(function() { WebAssembly.compile(bytes).then(function() { compiled = true }); wait() })')->();
+    is $nested, 0, 'no tasks run with JavaScript on the stack';
+
+    my $top = 0;
+    for (my $waited = 0; !$top && $waited < 10; $waited += 0.02) {
+        $top += $context->pump_message_loop;
+        sleep 0.02;
+    }
+    ok $top > 0, 'waiting tasks run at a safe point';
+
+    for (my $waited = 0; !$context->eval('compiled') && $waited < 10; $waited += 0.02) {
+        $context->pump_message_loop;
+        sleep 0.02;
+    }
+    ok $context->eval('compiled'), 'compilation finished';
+}
+
+my $callback = $context->eval('(function() { return pump() })');
+$context->bind(pump => sub { $context->pump_message_loop });
+is $callback->(), 0, 'not pumped with JavaScript running';
+
+my $async = JavaScript::V8::Context->new(timers => 1, microtasks => 'explicit', own_isolate => 1);
+$async->bind(pump => sub { $async->pump_message_loop });
+
+$async->eval('var from_timer; setTimeout(function() { from_timer = pump() }, 0)');
+$async->run_pending;
+is $async->eval('from_timer'), 0, 'not pumped from a timer';
+
+$async->eval('var from_microtask; Promise.resolve().then(function() { from_microtask = pump() })');
+$async->run_microtasks;
+is $async->eval('from_microtask'), 0, 'not pumped from a microtask';
+
+is $async->eval_async('Promise.resolve().then(function() { return pump() })'), 0,
+    'not pumped while settling';
+
+done_testing;
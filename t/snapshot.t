@@ -0,0 +1,47 @@
+#!/usr/bin/perl
+use Test::More;
+use File::Temp qw(tempdir);
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $dir = tempdir(CLEANUP => 1);
+my $file = "$dir/app.snapshot";
+
+is +JavaScript::V8::Context->create_snapshot(
+    file    => $file,
+    scripts => ['throw new Error("broken library")'],
+), undef, 'failing script';
+like $@, qr/broken library.*snapshot\[0\]/, 'error reported';
+ok !-e $file, 'no snapshot written';
+
+ok(JavaScript::V8::Context->create_snapshot(
+    file    => $file,
+    scripts => [
+        'var lib = { greet: function(name) { return "hello " + name; } };',
+        'lib.render = function(f) { return f(lib.greet("perl")); };',
+    ],
+), 'snapshot created') or diag $@;
+ok -s $file, 'snapshot written';
+
+my $latin1 = "var caf\xe9 = '\xe9t\xe9';";
+my $latin1_file = "$dir/latin1.snapshot";
+ok +JavaScript::V8::Context->create_snapshot(file => $latin1_file, scripts => [$latin1]), 'latin-1 source';
+ok !utf8::is_utf8($latin1), 'left as it was';
+is +JavaScript::V8::Context->new(snapshot => $latin1_file)->eval("caf\x{e9}"), "\x{e9}t\x{e9}", 'not truncated';
+
+my $context = JavaScript::V8::Context->new(snapshot => $file);
+is $context->eval('lib.greet("world")'), 'hello world', 'library restored';
+is $context->eval('lib.render(function(s) { return s.toUpperCase(); })'), 'HELLO PERL', 'restored functions';
+
+$context->bind(shout => sub { uc shift });
+is $context->eval('lib.render(shout)'), 'HELLO PERL', 'perl function passed to restored code';
+
+my $second = JavaScript::V8::Context->new(snapshot => $file);
+$second->eval('lib.greet = null');
+is $context->eval('typeof lib.greet'), 'function', 'each context gets its own copy';
+
+eval { JavaScript::V8::Context->new };
+like $@, qr/already created from/, 'other contexts must use the same snapshot';
+
+done_testing;
@@ -0,0 +1,43 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(stable_shapes => 1);
+
+my %record = map { $_ => ord } 'a' .. 'z';
+$context->bind(record => \%record);
+is $context->eval('Object.keys(record).join("")'), join('', 'a' .. 'z'), 'keys in sorted order';
+is $context->eval('record.q'), ord 'q', 'values kept';
+
+$context->bind(records => [ map { { name => "n$_", id => $_, score => $_ * 2 } } 1 .. 100 ]);
+is $context->eval('records.length'), 100, 'array of records';
+is $context->eval('records.reduce(function(sum, r) { return sum + r.score; }, 0)'), 10100, 'record values';
+ok $context->eval('records.every(function(r) { return Object.keys(r).join() == "id,name,score"; })'),
+    'records share key order';
+is $context->heap_statistics->{cached_shapes}, 2, 'one shape per key set';
+
+$context->bind(nested => { b => { y => 1, x => [ 1, 2 ] }, a => undef });
+is $context->eval('Object.keys(nested).join()'), 'a,b', 'outer keys sorted';
+is $context->eval('Object.keys(nested.b).join()'), 'x,y', 'inner keys sorted';
+is $context->eval('nested.b.x[1]'), 2, 'nested values kept';
+
+my %cyclic = (name => 'loop');
+$cyclic{self} = \%cyclic;
+$context->bind(cyclic => \%cyclic);
+ok $context->eval('cyclic.self === cyclic'), 'cycles preserved';
+
+$context->bind(unicode => { "\x{263a}" => 'smile', "caf\x{e9}" => 'coffee' });
+is $context->eval("unicode['\x{263a}']"), 'smile', 'utf8 keys';
+is $context->eval("unicode['caf\x{e9}']"), 'coffee', 'latin-1 keys';
+
+my %wide = map { ("k$_" => $_) } 1 .. 100;
+$context->bind(wide => \%wide);
+is $context->eval('Object.keys(wide).length'), 100, 'large hashes converted';
+
+$context->reset;
+$context->bind(record => \%record);
+is $context->eval('record.z'), ord 'z', 'shapes usable after reset';
+
+done_testing;
@@ -0,0 +1,70 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use Time::HiRes qw(time sleep);
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(timers => 1);
+
+$context->eval('var log = []; setTimeout(function(a, b) { log.push(a + b) }, 0, 1, 2)');
+is $context->eval('log.length'), 0, 'timers wait for run_pending';
+is $context->run_pending, 1, 'one timer run';
+is $context->eval('log.join()'), '3', 'with its arguments';
+is $context->run_pending, 0, 'nothing left';
+ok !defined $context->next_deadline, 'no deadline';
+
+my $start = time;
+$context->eval('var id = setTimeout(function() { log.push("late") }, 50)');
+my $deadline = $context->next_deadline;
+ok $deadline >= $start + 0.04 && $deadline <= time + 0.06, 'next deadline';
+is $context->run_pending, 0, 'not due yet';
+
+my $fd = $context->pending_fd;
+my $rin = '';
+vec($rin, $fd, 1) = 1;
+ok select(my $rout = $rin, undef, undef, 2), 'fd readable when due';
+is $context->run_pending, 1, 'ran';
+is $context->eval('log.join()'), '3,late', 'in order';
+
+$context->eval('var t = setTimeout(function() { log.push("never") }, 0); clearTimeout(t)');
+is $context->run_pending, 0, 'cleared';
+
+$context->eval('var n = 0, iv = setInterval(function() { if (++n == 3) clearInterval(iv) }, 1)');
+for (1 .. 100) {
+    $context->run_pending;
+    last if $context->eval('n') == 3;
+    sleep 0.005;
+}
+is $context->eval('n'), 3, 'intervals';
+
+$context->eval('for (var i = 0; i < 5; i++) setTimeout(function() {}, 0)');
+is $context->run_pending(2), 2, 'bounded';
+is $context->run_pending, 3, 'the rest';
+
+$context->eval('setTimeout(function() { throw new Error("tick") }, 0)');
+ok !defined $context->run_pending, 'errors';
+like $@, qr/tick/, 'in $@';
+
+is $context->eval_async('new Promise(function(resolve) { setTimeout(function() { resolve(42) }, 20) })'), 42, 'eval_async waits for timers';
+
+$context->eval('setTimeout(function() { log.push("dropped") }, 0)');
+$context->reset;
+is $context->pending_fd, $fd, 'pending_fd survives reset';
+is $context->run_pending, 0, 'timers do not';
+$context->eval('var fresh = 0; setTimeout(function() { fresh = 1 }, 10)');
+ok select(my $rout3 = $rin, undef, undef, 2), 'fd readable after reset';
+is $context->run_pending, 1, 'new timers run';
+is $context->eval('fresh'), 1, 'on the new global object';
+
+my $explicit = JavaScript::V8::Context->new(microtasks => 'explicit');
+$explicit->eval('var done = 0; Promise.resolve().then(function() { done = 1 })');
+$rin = '';
+vec($rin, $explicit->pending_fd, 1) = 1;
+ok select(my $rout2 = $rin, undef, undef, 0), 'fd readable for microtasks';
+$explicit->run_pending;
+is $explicit->eval('done'), 1, 'microtasks run';
+
+ok !JavaScript::V8::Context->new->eval('typeof setTimeout == "function"'), 'no timers by default';
+
+done_testing;
@@ -0,0 +1,46 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8;
+use strict;
+use warnings;
+
+my $context = JavaScript::V8::Context->new(typed_arrays => 1);
+
+$context->bind(ints => [ 1 .. 1000 ]);
+is $context->eval('ints instanceof Int32Array'), 1, 'integers become an Int32Array';
+is $context->eval('ints.reduce(function(a, b) { return a + b })'), 500500, 'values';
+
+$context->bind(floats => [ 1, 2.5, -3 ]);
+is $context->eval('floats instanceof Float64Array'), 1, 'mixed numbers become a Float64Array';
+is $context->eval('floats[1]'), 2.5, 'float values';
+
+$context->bind(big => [ 1, 2**40 ]);
+is $context->eval('big instanceof Float64Array'), 1, 'large integers need doubles';
+is $context->eval('big[1]'), 2**40, 'large values';
+
+$context->bind(mixed => [ 1, 'two', 3 ]);
+ok $context->eval('Array.isArray(mixed)'), 'strings keep an Array';
+$context->bind(holes => [ 1, undef, 3 ]);
+ok $context->eval('Array.isArray(holes)'), 'undef keeps an Array';
+$context->bind(nested => [ [ 1, 2 ], [ 3 ] ]);
+is $context->eval('nested[0] instanceof Int32Array'), 1, 'nested arrays';
+$context->bind(empty => []);
+ok $context->eval('Array.isArray(empty)'), 'empty arrays stay arrays';
+
+is_deeply $context->eval('new Int32Array([1, -2, 3])'), [ 1, -2, 3 ], 'Int32Array to Perl';
+is_deeply $context->eval('new Float64Array([0.5, 1e300])'), [ 0.5, 1e300 ], 'Float64Array to Perl';
+is_deeply $context->eval('new Uint16Array([65535, 1])'), [ 65535, 1 ], 'Uint16Array to Perl';
+is_deeply $context->eval('new Int8Array([-128, 127])'), [ -128, 127 ], 'Int8Array to Perl';
+is_deeply $context->eval('new Uint32Array([4294967295])'), [ 4294967295 ], 'Uint32Array to Perl';
+is_deeply $context->eval('new Float32Array([0.5, 2])'), [ 0.5, 2 ], 'Float32Array to Perl';
+is_deeply $context->eval('new Int32Array(new ArrayBuffer(16), 4, 2)'), [ 0, 0 ], 'offset views';
+is_deeply $context->eval('new Float64Array(0)'), [], 'empty typed arrays';
+is_deeply $context->eval('ints'), [ 1 .. 1000 ], 'round trip';
+
+my $plain = JavaScript::V8::Context->new;
+$plain->bind(ints => [ 1, 2, 3 ]);
+ok $plain->eval('Array.isArray(ints)'), 'off by default';
+is_deeply $plain->eval('[1, [2, "x"], null]'), [ 1, [ 2, 'x' ], undef ], 'ordinary arrays';
+is_deeply $plain->eval('new Int32Array([7])'), [ 7 ], 'typed arrays to Perl by default';
+
+done_testing;
@@ -29,4 +29,27 @@ is $context->eval('(function(v) { return v + 2; })')->($val), '32', 'string conv
 is $context->eval('"тест"'), 'тест', 'utf8 ok';
 is $context->eval('(function(v) { return v; })')->('тест'), 'тест';
 
+my $echo = $context->eval('(function(v) { return v; })');
+my $latin1 = "caf\xe9";
+utf8::downgrade($latin1);
+is $echo->($latin1), "caf\x{e9}", 'latin-1 byte strings';
+is $context->eval('(function(v) { return v.length; })')->($latin1), 4, 'latin-1 length';
+my $ascii = 'x' x 100;
+utf8::upgrade($ascii);
+is $echo->($ascii), $ascii, 'ascii in utf8 strings';
+is $echo->("a\0b"), "a\0b", 'embedded nul';
+is $echo->('x' x 40 . "\x{263a}"), 'x' x 40 . "\x{263a}", 'non-ascii after a long ascii run';
+is $context->eval('"\\uD800x"'), "\x{fffd}x", 'lone surrogates';
+
+my $large = 'abc' x 100_000;
+$context->bind(large => $large);
+substr($large, 0, 3, 'xyz');
+is $context->eval('large.length'), 300_000, 'large strings';
+is $context->eval('large.slice(0, 6)'), 'abcabc', 'changing the original leaves them alone';
+is $context->eval("'$large'.length"), 300_000, 'large sources';
+
+my $source = "'" . ("\xe9" x 100_000) . "'.length";
+is $context->eval($source), 100_000, 'large latin-1 sources';
+ok !utf8::is_utf8($source), 'are left as byte strings';
+
 done_testing;
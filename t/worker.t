@@ -0,0 +1,78 @@
+#!/usr/bin/perl
+use Test::More;
+use JavaScript::V8::Worker;
+use strict;
+use warnings;
+
+my $worker = JavaScript::V8::Worker->new(script => <<'JS');
+    var count = 0;
+    onmessage = function(event) {
+        var data = event.data;
+        if (data === 'fail') throw new Error('handler failed');
+        if (data === 'buffer') {
+            var buffer = new Uint8Array([104, 105]).buffer;
+            postMessage(buffer, [buffer]);
+            postMessage(buffer.byteLength);
+            return;
+        }
+        if (data instanceof ArrayBuffer) {
+            postMessage(String.fromCharCode.apply(null, new Uint8Array(data)));
+            return;
+        }
+        if (data === 'close') { close(); return; }
+        postMessage({ count: ++count, echo: data });
+    };
+    postMessage('ready');
+JS
+
+ok $worker->running, 'running';
+is $worker->wait_message(5), 'ready', 'script ran';
+is $worker->get_message, undef, 'nothing waiting';
+ok !$@, 'no error';
+
+$worker->post_message({ list => [1, 2, 3], name => "caf\x{e9}" });
+is_deeply $worker->wait_message(5), { count => 1, echo => { list => [1, 2, 3], name => "caf\x{e9}" } },
+    'round trip';
+
+$worker->post_message($_) for 1 .. 3;
+is $worker->wait_message(5)->{echo}, $_, "message $_ in order" for 1 .. 3;
+
+$worker->post_message('fail');
+is $worker->wait_message(5), undef, 'no value for an error';
+like $@, qr/handler failed at worker:/, 'error reported';
+
+eval { $worker->post_message(sub { 1 }) };
+ok $@, 'functions cannot be posted';
+
+$worker->post_message('buffer');
+my $bytes = \ $worker->wait_message(5);
+is $$bytes, 'hi', 'transferred buffer';
+is $worker->wait_message(5), 0, 'neutered in the worker';
+
+$worker->post_message($$bytes, [$$bytes]);
+is $worker->wait_message(5), 'hi', 'transferred back';
+is $$bytes, '', 'string emptied';
+
+eval { $worker->post_message('x', ['x']) };
+like $@, qr/only buffers returned by JavaScript/, 'plain strings cannot be transferred';
+
+$worker->post_message('close');
+ok !defined $worker->wait_message(5) && !$@, 'closed';
+ok !$worker->running, 'stopped';
+
+my $failed = JavaScript::V8::Worker->new(script => 'postMessage(1); throw new Error("boom")', origin => 'w.js');
+is $failed->wait_message(5), 1, 'posted before failing';
+is $failed->wait_message(5), undef, 'error';
+like $@, qr/boom at w.js:1/, 'script error reported';
+ok !$failed->wait_message(5) && !$failed->running, 'stopped after failing';
+
+my $busy = JavaScript::V8::Worker->new(script => 'postMessage(1); for (;;) {}');
+is $busy->wait_message(5), 1, 'busy worker started';
+$busy->terminate;
+ok !$busy->running, 'terminated';
+$busy->terminate;
+
+eval { JavaScript::V8::Worker->new };
+is $@, "JavaScript::V8::Worker needs a script\n", 'script required';
+
+done_testing;